@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void) (addr), (void) (size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void) (addr), (void) (size))
+#endif
+
+size_t arena_size(size_t size) {
+    return ((size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1)) + ARENA_REDZONE;
+}
+
+#define HUGE_PAGES_OFF 0
+#define HUGE_PAGES_TRANSPARENT 1
+#define HUGE_PAGES_HUGETLB 2
+
+/*The huge page policy LZW_HUGE_PAGES asks for, one of HUGE_PAGES_*.*/
+int __arena_huge_pages_policy() {
+    const char *setting = getenv("LZW_HUGE_PAGES");
+    if (setting == NULL)
+        return HUGE_PAGES_TRANSPARENT;
+    if (strcmp(setting, "0") == 0)
+        return HUGE_PAGES_OFF;
+    return strcmp(setting, "hugetlb") == 0 ? HUGE_PAGES_HUGETLB : HUGE_PAGES_TRANSPARENT;
+}
+
+static inline size_t __round_to_huge_pages(size_t size) {
+    return (size + ARENA_HUGE_PAGE_SIZE - 1) & ~(size_t) (ARENA_HUGE_PAGE_SIZE - 1);
+}
+
+size_t arena_footprint(size_t size) {
+    size = arena_size(size);
+    if (size >= ARENA_HUGE_PAGE_SIZE && __arena_huge_pages_policy() == HUGE_PAGES_HUGETLB)
+        return __round_to_huge_pages(size);
+    return size;
+}
+
+/*Maps a->size bytes starting on a huge page boundary, so that as much of the arena as possible
+can later be backed by huge pages. Sets a->base, or returns -1.*/
+int __arena_map_aligned(arena *a) {
+    // we map one huge page more than needed and unmap what lies outside the aligned part;
+    // the mapping isn't rounded up, so the arena never takes up more than a->size bytes
+    long page = sysconf(_SC_PAGESIZE);
+    size_t padded = a->size + ARENA_HUGE_PAGE_SIZE;
+    unsigned char *map = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+        return -1;
+
+    unsigned char *aligned = (unsigned char *) (((uintptr_t) map + ARENA_HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (ARENA_HUGE_PAGE_SIZE - 1));
+    unsigned char *end = aligned + ((a->size + page - 1) & ~(size_t) (page - 1));
+    if (aligned > map)
+        munmap(map, aligned - map);
+    if (map + padded > end)
+        munmap(end, map + padded - end);
+
+    a->base = aligned;
+    return 0;
+}
+
+arena *arena_new(size_t size) {
+    arena *a = malloc(sizeof(arena));
+    a->size = arena_size(size);
+    a->used = 0;
+    a->pages = ARENA_PAGES_NORMAL;
+
+    int policy = (a->size >= ARENA_HUGE_PAGE_SIZE) ? __arena_huge_pages_policy() : HUGE_PAGES_OFF;
+
+    // reserved huge pages are taken from the pool when they are mapped, so we must not pass
+    // MAP_NORESERVE, or running out of them would be a SIGBUS instead of a failed mmap
+    if (policy == HUGE_PAGES_HUGETLB) {
+        size_t rounded = __round_to_huge_pages(a->size);
+        a->base = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (a->base != MAP_FAILED) {
+            a->size = rounded;
+            a->pages = ARENA_PAGES_HUGETLB;
+            ASAN_POISON_MEMORY_REGION(a->base, a->size);
+            return a;
+        }
+    }
+
+    if (policy != HUGE_PAGES_OFF && __arena_map_aligned(a) == 0) {
+        a->pages = ARENA_PAGES_DEFERRED;
+        ASAN_POISON_MEMORY_REGION(a->base, a->size);
+        return a;
+    }
+
+    // we map the pages directly so that untouched ones never get backed by memory,
+    // which malloc doesn't promise for allocations it serves from the heap
+    a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (a->base == MAP_FAILED) {
+        perror("arena: mmap");
+        abort();
+    }
+    ASAN_POISON_MEMORY_REGION(a->base, a->size);
+
+    return a;
+}
+
+void arena_use_huge_pages(arena *a) {
+    if (a->pages != ARENA_PAGES_DEFERRED)
+        return;
+    a->pages = madvise(a->base, a->size, MADV_HUGEPAGE) == 0 ? ARENA_PAGES_TRANSPARENT : ARENA_PAGES_NORMAL;
+}
+
+void *arena_alloc(arena *a, size_t request) {
+    size_t size = arena_size(request);
+    if (size > a->size - a->used) {
+        fprintf(stderr, "arena: out of space\n");
+        abort();
+    }
+
+    void *ptr = a->base + a->used;
+    a->used += size;
+    ASAN_UNPOISON_MEMORY_REGION(ptr, request);
+    return ptr;
+}
+
+void arena_free(arena *a) {
+    ASAN_UNPOISON_MEMORY_REGION(a->base, a->size);
+    munmap(a->base, a->size);
+    free(a);
+}
@@ -0,0 +1,83 @@
+/*
+Bump allocator over one block of address space reserved from the OS up front.
+
+An arena is sized for the most its owner can ever need, so the owner never has to
+allocate again. The reservation only costs physical memory for the pages that have
+actually been touched, so a table sized for 2^20 codes that only ever holds a few
+thousand still only takes up a few pages.
+
+Large tables are probed at random, so once they outgrow a huge page they miss the TLB on top
+of the cache. Arenas of at least ARENA_HUGE_PAGE_SIZE therefore start on a huge page boundary,
+and once their owner calls arena_use_huge_pages, which tables do when they grow past a huge
+page, they ask for transparent huge pages with madvise(MADV_HUGEPAGE). Until then they keep
+normal pages, so a big table that only holds a few codes still only takes up a few pages.
+If the kernel refuses, the arena keeps normal pages too.
+
+The LZW_HUGE_PAGES environment variable picks the policy: 0 keeps normal pages throughout, and
+hugetlb takes large arenas from the reserved huge page pool (MAP_HUGETLB) up front, rounded up
+to whole huge pages, falling back to transparent huge pages if the pool is too small.
+*/
+#ifndef ARENA
+#define ARENA
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 64 // Every allocation starts on its own cache line.
+#define ARENA_HUGE_PAGE_SIZE (2 << 20) // x86-64 and arm64 with 4 KiB base pages
+
+// How an arena's pages are backed.
+#define ARENA_PAGES_NORMAL 0
+#define ARENA_PAGES_DEFERRED 1 // normal pages until arena_use_huge_pages is called
+#define ARENA_PAGES_TRANSPARENT 2 // madvise(MADV_HUGEPAGE), which the kernel may or may not honour
+#define ARENA_PAGES_HUGETLB 3 // reserved huge pages
+
+/*
+AddressSanitizer can't see the bounds of allocations carved out of an arena, so in sanitized
+builds the arena poisons all of its memory and only unpoisons what it hands out, leaving a
+poisoned redzone after every allocation.
+*/
+#if defined(__SANITIZE_ADDRESS__)
+#define ARENA_REDZONE ARENA_ALIGNMENT
+#else
+#define ARENA_REDZONE 0
+#endif
+
+struct arena {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    int pages; // one of ARENA_PAGES_*
+};
+
+typedef struct arena arena;
+
+/*
+Reserves an arena of at least size bytes. Its memory reads as zero until written.
+The returned arena is dynamically allocated and therefore must be freed.
+*/
+arena *arena_new(size_t size);
+
+/*
+Returns size bytes from the arena, aligned to ARENA_ALIGNMENT.
+The arena must have been created large enough; running out of space aborts the program.
+*/
+void *arena_alloc(arena *a, size_t size);
+
+// The number of bytes arena_alloc hands out for a request of size bytes.
+size_t arena_size(size_t size);
+
+/*
+The most memory an arena created for size bytes can take up: size itself, or size rounded up
+to whole huge pages if it is taken from the reserved pool.
+*/
+size_t arena_footprint(size_t size);
+
+/*
+Asks for the arena's memory to be backed by huge pages from now on, if it is large enough and
+LZW_HUGE_PAGES allows it. Only the first call makes a system call, later ones return at once.
+*/
+void arena_use_huge_pages(arena *a);
+
+// Returns the arena's memory to the OS, along with everything allocated from it.
+void arena_free(arena *a);
+
+#endif
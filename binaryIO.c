@@ -1,113 +1,76 @@
 #include "binaryIO.h"
-
-int binaryio_buffer_push(binaryio_buffer *b_buffer, int bit) {
-
-    if (b_buffer->size == BUFFER_MAX)
-        return -1;
-
-    b_buffer->buffer = (b_buffer->buffer << 1) | (bit & 1);
-    b_buffer->size++; 
-
-    return 0;
+#include <string.h>
+
+binaryio_writer *binaryio_writer_new() {
+    binaryio_writer *writer = malloc(sizeof(binaryio_writer));
+    writer->capacity = 4096;
+    writer->data = malloc(writer->capacity);
+    writer->size = 0;
+    writer->acc = 0;
+    writer->bits = 0;
+    return writer;
 }
 
-int binaryio_buffer_pop(binaryio_buffer *b_buffer) {
+void binaryio_writer_reserve(binaryio_writer *writer, size_t extra) {
+    if (writer->size + extra <= writer->capacity)
+        return;
 
-    if (b_buffer->size == 0)
-        return -1;
-    // we get the leftmost bit
-    int bit = (b_buffer->buffer >> (b_buffer->size - 1)) & 1; 
+    while (writer->size + extra > writer->capacity)
+        writer->capacity *= 2;
+    writer->data = realloc(writer->data, writer->capacity);
+}
 
-    // now we set the leftmost bit to 0
-    int mask = 1 << (b_buffer->size - 1);
-    b_buffer->buffer &= ~mask; 
-    b_buffer->size--; 
+void binaryio_writer_put(binaryio_writer *writer, int data, int num_bits) {
+    writer->acc = (writer->acc << num_bits) | ((uint64_t) data & ((1ULL << num_bits) - 1));
+    writer->bits += num_bits;
 
-    return bit; 
+    // at most 4 full bytes can be pending after adding 32 bits to a partial byte
+    binaryio_writer_reserve(writer, 5);
+    while (writer->bits >= CHAR_BIT) {
+        writer->bits -= CHAR_BIT;
+        writer->data[writer->size++] = (unsigned char) (writer->acc >> writer->bits);
+    }
 }
 
-void binaryio_buffer_clear(binaryio_buffer *b_buffer) {
-    b_buffer->size = 0;
-    b_buffer->buffer = 0; 
+void binaryio_writer_put_bytes(binaryio_writer *writer, const unsigned char *bytes, size_t num_bytes) {
+    binaryio_writer_reserve(writer, num_bytes);
+    memcpy(writer->data + writer->size, bytes, num_bytes);
+    writer->size += num_bytes;
 }
 
-void binaryio_buffer_write(FILE* stream, binaryio_buffer *b_buffer) {
-    // we pad with 0s in the back if necessary
-    b_buffer->buffer = b_buffer->buffer << (BUFFER_MAX - b_buffer->size); 
-
-    fwrite(&(b_buffer->buffer), 1, 1, stream); 
-
-    // we clear the buffer
-    binaryio_buffer_clear(b_buffer); 
-
+void binaryio_writer_flush(binaryio_writer *writer) {
+    if (writer->bits > 0)
+        binaryio_writer_put(writer, 0, CHAR_BIT - writer->bits);
 }
 
-void binary_write(FILE* stream, binaryio_buffer *b_buffer, int data, int num_bits, int flush) {
-    for (int i = num_bits - 1; i >= 0; i--) {
-
-        int bit = (data >> i) & 1; 
-
-        if (binaryio_buffer_push(b_buffer, bit) == -1) {
-    
-            binaryio_buffer_write(stream, b_buffer);
-            binaryio_buffer_push(b_buffer, bit); 
-        }
-    }
-
-    // in case we flush the buffer
-    if (b_buffer->size > 0 && flush) {
-        binaryio_buffer_write(stream, b_buffer);
-    }
-
+void binaryio_writer_reset(binaryio_writer *writer) {
+    writer->size = 0;
+    writer->acc = 0;
+    writer->bits = 0;
 }
 
-int binary_read(FILE* stream, binaryio_buffer *b_buffer, int *data, int num_bits) {
-    int result = 0; 
-    int i = 0;
-
-    while (i < num_bits) {
-    
-        // we get anything left in the buffer first
-        if (b_buffer->size) {
-            int bit = binaryio_buffer_pop(b_buffer);
-            if (bit != -1) {
-                result = (result << 1) | bit;
-                i++; 
-            }
-        }
-
-        // now we get a byte from the specified stream
-        else {
-            unsigned char byte;
-            if (fread(&byte, 1, 1, stream) < 1) { // we've reached EOF
-                *data = result; 
-                return -1; 
-            }
-        
-            // we add bits from the byte we read to the result
-            // we stop whenever we've fully consumed the byte
-            // or we've read as many bits as we need to, whichever comes first
-            int cur_bits_read = 0;
-            while (cur_bits_read < CHAR_BIT && i < num_bits) {
-                int bit = (byte >> (CHAR_BIT - cur_bits_read - 1)) & 1;
-                result = (result << 1) | bit;
-                i++; 
-                cur_bits_read++; 
-            }
-
-            // we have left over bits, which we store in the bin buffer
-            while (i >= num_bits && cur_bits_read < CHAR_BIT) {
-                int bit = (byte >> (CHAR_BIT - cur_bits_read - 1)) & 1;
-                binaryio_buffer_push(b_buffer, bit);
-                cur_bits_read++;
-            }
+void binaryio_writer_free(binaryio_writer *writer) {
+    free(writer->data);
+    free(writer);
+}
 
-        }
+void binaryio_reader_init(binaryio_reader *reader, const unsigned char *data, size_t size) {
+    reader->data = data;
+    reader->size = size;
+    reader->pos = 0;
+    reader->acc = 0;
+    reader->bits = 0;
+}
 
+int binaryio_reader_get(binaryio_reader *reader, int *data, int num_bits) {
+    while (reader->bits < num_bits) {
+        if (reader->pos >= reader->size)
+            return -1;
+        reader->acc = (reader->acc << CHAR_BIT) | reader->data[reader->pos++];
+        reader->bits += CHAR_BIT;
     }
 
-    *data = result;
-    return 1; 
-
-
+    reader->bits -= num_bits;
+    *data = (int) ((reader->acc >> reader->bits) & ((1ULL << num_bits) - 1));
+    return 1;
 }
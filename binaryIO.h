@@ -1,59 +1,77 @@
 /*
 Custom library for working with binary I/O in C.
-Supports reading and writing from a file stream at the granularity of bits.
+Supports bit-level reading and writing of in-memory byte buffers.
 */
 #ifndef BINARY_IO
 #define BINARY_IO
 #include <stdio.h>
 #include <stdint.h>
-#define BUFFER_MAX 8
+#include <stdlib.h>
+#ifndef CHAR_BIT
 #define CHAR_BIT 8
-
-struct binaryio_buffer {
-    unsigned char buffer; 
-    int size;
-}; 
-
-typedef struct binaryio_buffer binaryio_buffer; 
+#endif
 
 /*
-Attempts to add a singular bit to the binary buffer.
-Bits are added to the right of a binary buffer.
-If the buffer is full, this operation fails and returns -1.
-If it is not full, the bit is added and returns 0.
+Writes bits into a growable in-memory byte array, most significant bit first, the order
+binaryio_reader reads them back in. Pending bits are kept in a 64-bit accumulator
+so whole codes are written with a couple of shifts instead of one bit at a time.
 */
-int binaryio_buffer_push(binaryio_buffer *b_buffer, int bit);
+struct binaryio_writer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+
+    uint64_t acc; // pending bits, right aligned
+    int bits;     // number of pending bits in acc
+};
+
+typedef struct binaryio_writer binaryio_writer;
 
 /*
-Attempts to pop the leftmost bit from the binary buffer.
-This operation fails and returns -1 when the buffer is empty.
-Otherwise, it returns the popped bit. 
+Reads bits from an in-memory byte array, most significant bit first.
+The reader doesn't own the array it reads from.
 */
-int binaryio_buffer_pop(binaryio_buffer *b_buffer);
+struct binaryio_reader {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+
+    uint64_t acc;
+    int bits;
+};
+
+typedef struct binaryio_reader binaryio_reader;
 
-// Clears a binary buffer.
-void binaryio_buffer_clear(binaryio_buffer *b_buffer);
+// Constructs a new empty binary writer.
+binaryio_writer *binaryio_writer_new();
 
 /*
-Writes the binary buffer to the specified stream.
-If the binary buffer is not full, the buffer will be padded with 0's in the back.
-This operation clears the binary buffer after writing to the stream.
+Appends the lowest num_bits bits of data to the writer. num_bits can be at most 32.
 */
-void binaryio_buffer_write(FILE* stream, binaryio_buffer *b_buffer);
+void binaryio_writer_put(binaryio_writer *writer, int data, int num_bits);
+
+// Makes sure at least extra more bytes fit in the writer without it growing.
+void binaryio_writer_reserve(binaryio_writer *writer, size_t extra);
+
+// Appends num_bytes whole bytes to the writer. The writer must be byte aligned.
+void binaryio_writer_put_bytes(binaryio_writer *writer, const unsigned char *bytes, size_t num_bytes);
+
+// Pads any pending bits with 0's up to the next byte boundary.
+void binaryio_writer_flush(binaryio_writer *writer);
+
+// Empties the writer, keeping its allocated memory for reuse.
+void binaryio_writer_reset(binaryio_writer *writer);
+
+// Frees a binary writer and its data.
+void binaryio_writer_free(binaryio_writer *writer);
+
+// Initializes a reader over the size bytes at data.
+void binaryio_reader_init(binaryio_reader *reader, const unsigned char *data, size_t size);
 
 /*
-Writes an integer to a specified stream in binary mode
-using the amount of bits specified by num_bits and the
-specified bin_buffer as the buffer. If flush is set to true, 
-whatever remains in the buffer is sent to the file stream 
-even if the buffer is not full (in which case it is padded with 0's)*/
-void binary_write(FILE* stream, binaryio_buffer *b_buffer, int data, int num_bits, int flush);
-
-/* Reads num_bits from the specified stream, storing an integer representation of the bits in data.
-Supports buffered operations by first trying to read from the binary buffer, and then reading the rest
-from the stream. Since stream is read 1 byte at a time, any bits not consumed will be stored in reverse order
-within the bin_buffer. Returns 1 if it sucessfully read the specified number of bits, -1 otherwise. 
+Reads num_bits bits (at most 32) from the reader, storing them in data.
+Returns 1 on success and -1 if the buffer runs out first.
 */
-int binary_read(FILE* stream, binaryio_buffer *b_buffer, int *data, int num_bits); 
+int binaryio_reader_get(binaryio_reader *reader, int *data, int num_bits);
 
 #endif
\ No newline at end of file
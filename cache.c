@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "format.h"
+
+#define CACHE_CHECK_SIZE 8 // the second hash, at the start of every entry
+#define CACHE_ENTRY_MAX (CACHE_CHECK_SIZE + BLOCK_HEADER_SIZE + BLOCK_PAYLOAD_MAX)
+#define CACHE_NAME_LENGTH 20 // 16 hex digits and ".blk"
+#define CACHE_CHECK_SEED 0xA0761D6478BD642FULL
+#define CACHE_RECORD_SEED 0xE7037ED1A0B428DBULL
+
+/*The finalizer of MurmurHash3, which makes every bit of the result depend on every bit of x.*/
+static inline uint64_t __cache_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/*Hashes len bytes 8 at a time, which keeps up with reading them from memory. The seed picks
+one of many unrelated hash functions.*/
+uint64_t __cache_hash(const unsigned char *bytes, size_t len, uint64_t seed) {
+    uint64_t h = __cache_mix(seed ^ (len * 0x9E3779B97F4A7C15ULL));
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        word *= 0x87C37B91114253D5ULL;
+        h ^= (word << 31) | (word >> 33);
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+    }
+
+    // the last few bytes make up a partial word
+    uint64_t word = 0;
+    for (; i < len; i++)
+        word = (word << 8) | bytes[i];
+    return __cache_mix(h ^ __cache_mix(word));
+}
+
+/*The check stored with an entry: a second hash of the block, which guards against two blocks
+sharing a key, combined with a hash of the record, which guards against damaged entries.*/
+uint64_t __cache_check(block_cache *c, const unsigned char *block, size_t len, const unsigned char *record, size_t record_size) {
+    return __cache_hash(block, len, c->settings ^ CACHE_CHECK_SEED) ^ __cache_hash(record, record_size, CACHE_RECORD_SEED);
+}
+
+/*Points c->path at the entry for the given key.*/
+void __cache_path(block_cache *c, uint64_t key) {
+    sprintf(c->path, "%s/%016llx.blk", c->dir, (unsigned long long) key);
+}
+
+/*Reads until size bytes were read or the file ends. Returns the number of bytes read, or -1.*/
+ssize_t __cache_read(int fd, unsigned char *buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+/*Writes all size bytes. Returns 0 on success, or -1.*/
+int __cache_write(int fd, const unsigned char *buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+/*An entry found in the cache directory.*/
+struct cache_file {
+    char name[CACHE_NAME_LENGTH + 1];
+    struct timespec mtime;
+    uint64_t size;
+};
+
+typedef struct cache_file cache_file;
+
+int __cache_file_compare(const void *a, const void *b) {
+    const struct timespec *x = &((const cache_file *) a)->mtime;
+    const struct timespec *y = &((const cache_file *) b)->mtime;
+    if (x->tv_sec != y->tv_sec)
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/*Lists the entries in the cache directory, oldest first, into *files, which must be freed,
+and sets c->used to their total size. Returns the number of entries, or -1.*/
+ssize_t __cache_scan(block_cache *c, cache_file **files) {
+    DIR *dir = opendir(c->dir);
+    if (dir == NULL)
+        return -1;
+
+    size_t count = 0, capacity = 256;
+    *files = malloc(capacity * sizeof(cache_file));
+    c->used = 0;
+
+    struct dirent *d;
+    while ((d = readdir(dir)) != NULL) {
+        size_t len = strlen(d->d_name);
+        if (len != CACHE_NAME_LENGTH || strcmp(d->d_name + len - 4, ".blk") != 0)
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), d->d_name, &st, 0) != 0)
+            continue; // another process evicted it in the meantime
+
+        if (count == capacity) {
+            capacity *= 2;
+            *files = realloc(*files, capacity * sizeof(cache_file));
+        }
+        cache_file *f = &(*files)[count++];
+        memcpy(f->name, d->d_name, CACHE_NAME_LENGTH + 1);
+        f->mtime = st.st_mtim;
+        f->size = st.st_size;
+        c->used += st.st_size;
+    }
+    closedir(dir);
+
+    qsort(*files, count, sizeof(cache_file), __cache_file_compare);
+    return count;
+}
+
+/*Deletes the least recently used entries until the rest fit in CACHE_EVICT_TO of the cap.
+We go below the cap so that the directory is only scanned every so often.*/
+void __cache_evict(block_cache *c) {
+    cache_file *files;
+    ssize_t count = __cache_scan(c, &files);
+    if (count < 0)
+        return;
+
+    uint64_t target = c->capacity * CACHE_EVICT_TO;
+    for (ssize_t i = 0; i < count && c->used > target; i++) {
+        sprintf(c->path, "%s/%s", c->dir, files[i].name);
+        if (unlink(c->path) == 0)
+            c->evictions++;
+        c->used -= files[i].size;
+    }
+    free(files);
+}
+
+block_cache *block_cache_new(const char *dir, size_t capacity, int max_bits, int streams, int flags) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("cache: mkdir");
+        return NULL;
+    }
+
+    block_cache *c = calloc(1, sizeof(block_cache));
+    c->dir = strdup(dir);
+    c->path = malloc(strlen(dir) + 64);
+    c->tmp_path = malloc(strlen(dir) + 64);
+    c->settings = ((uint32_t) STREAM_VERSION << 24) | (max_bits << 16) | (flags << 8) | streams;
+    c->capacity = capacity;
+    c->entry = malloc(CACHE_ENTRY_MAX + 1);
+
+    cache_file *files;
+    if (__cache_scan(c, &files) < 0) {
+        perror("cache: opendir");
+        block_cache_free(c);
+        return NULL;
+    }
+    free(files);
+
+    if (c->used > c->capacity)
+        __cache_evict(c);
+    return c;
+}
+
+int block_cache_get(block_cache *c, const unsigned char *block, size_t len, binaryio_writer *record) {
+    __cache_path(c, __cache_hash(block, len, c->settings));
+
+    int fd = open(c->path, O_RDONLY);
+    if (fd < 0) {
+        c->misses++;
+        return 0;
+    }
+
+    // we read one byte more than any entry can hold, so that an oversized file doesn't pass
+    ssize_t n = __cache_read(fd, c->entry, CACHE_ENTRY_MAX + 1);
+    block_header header;
+    int valid = 0;
+
+    if (n >= CACHE_CHECK_SIZE + BLOCK_HEADER_SIZE) {
+        uint64_t check = __cache_check(c, block, len, c->entry + CACHE_CHECK_SIZE, n - CACHE_CHECK_SIZE);
+        block_header_unpack(&header, c->entry + CACHE_CHECK_SIZE);
+
+        valid = unpack_u32(c->entry) == (uint32_t) (check >> 32) && unpack_u32(c->entry + 4) == (uint32_t) check
+            && header.type != BLOCK_END && header.raw_size == len
+            && header.payload_size == n - CACHE_CHECK_SIZE - BLOCK_HEADER_SIZE;
+    }
+
+    // a hit makes the entry the most recently used one
+    if (valid)
+        futimens(fd, NULL);
+    close(fd);
+
+    if (!valid) {
+        c->misses++;
+        return 0;
+    }
+
+    binaryio_writer_reset(record);
+    binaryio_writer_put_bytes(record, c->entry + CACHE_CHECK_SIZE, n - CACHE_CHECK_SIZE);
+    c->hits++;
+    return 1;
+}
+
+void block_cache_put(block_cache *c, const unsigned char *block, size_t len, const binaryio_writer *record) {
+    uint64_t key = __cache_hash(block, len, c->settings);
+    uint64_t check = __cache_check(c, block, len, record->data, record->size);
+
+    unsigned char check_bytes[CACHE_CHECK_SIZE];
+    pack_u32(check >> 32, check_bytes);
+    pack_u32(check, check_bytes + 4);
+
+    // the entry only appears under its name once it is complete
+    __cache_path(c, key);
+    sprintf(c->tmp_path, "%s/.tmp.%ld.%016llx", c->dir, (long) getpid(), (unsigned long long) key);
+
+    int fd = open(c->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    int failed = __cache_write(fd, check_bytes, CACHE_CHECK_SIZE) != 0
+        || __cache_write(fd, record->data, record->size) != 0;
+    failed |= close(fd) != 0;
+
+    if (failed || rename(c->tmp_path, c->path) != 0) {
+        unlink(c->tmp_path);
+        return;
+    }
+
+    c->used += CACHE_CHECK_SIZE + record->size;
+    if (c->used > c->capacity)
+        __cache_evict(c);
+}
+
+size_t block_cache_memory() {
+    return CACHE_ENTRY_MAX + 1;
+}
+
+void block_cache_report(block_cache *c, const char *name, FILE *f) {
+    uint64_t lookups = c->hits + c->misses;
+    fprintf(f, "%s: cache hits %llu of %llu blocks (%.1f%%), %llu evicted, %.1f of %.1f MiB used\n",
+        name, (unsigned long long) c->hits, (unsigned long long) lookups, lookups ? 100.0 * c->hits / lookups : 0.0,
+        (unsigned long long) c->evictions, c->used / 1048576.0, c->capacity / 1048576.0);
+}
+
+void block_cache_free(block_cache *c) {
+    free(c->dir);
+    free(c->path);
+    free(c->tmp_path);
+    free(c->entry);
+    free(c);
+}
@@ -0,0 +1,70 @@
+/*
+A persistent, content-addressed cache of compressed blocks.
+
+When a file is compressed again after only a few regions changed, most of its blocks are the
+same as last time. With STREAM_FLAG_INDEPENDENT a block's record depends only on its bytes and
+the stream settings, so it can be looked up by a hash of the two instead of being coded again.
+
+Every entry is a file in the cache directory, named after a 64-bit hash of the block and the
+settings. The file holds a check, which must match as well, followed by the record: the check combines a
+second, differently seeded hash of the block with a hash of the record, so neither two blocks
+that share a name nor a damaged file can return a wrong record. Hits refresh the file's modification time, and once the entries outgrow
+the size cap the least recently used ones are deleted until they take up CACHE_EVICT_TO of it.
+Entries are written to a temporary file and renamed into place, so processes can share a cache.
+*/
+#ifndef CACHE
+#define CACHE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "binaryIO.h"
+
+#define CACHE_EVICT_TO 0.9 // eviction stops once the entries fit in this fraction of the cap
+
+struct block_cache {
+    char *dir;
+    char *path; // scratch space for entry paths
+    char *tmp_path; // scratch space for the path an entry is written to before it is renamed
+    uint32_t settings; // format version, max_bits, flags and streams, which are part of every key
+
+    uint64_t capacity; // bytes
+    uint64_t used; // bytes taken up by entries, as of the last scan plus what we added since
+
+    unsigned char *entry; // scratch space for reading an entry
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+typedef struct block_cache block_cache;
+
+/*
+Opens the cache in dir, creating the directory if needed, for streams with the given settings.
+The returned cache is dynamically allocated and therefore must be freed. Returns NULL, after
+printing why, if the directory can't be used.
+*/
+block_cache *block_cache_new(const char *dir, size_t capacity, int max_bits, int streams, int flags);
+
+/*
+Looks up the record of the len byte block at block. On a hit, the record replaces the contents
+of record and 1 is returned; on a miss, record is left alone and 0 is returned.
+*/
+int block_cache_get(block_cache *c, const unsigned char *block, size_t len, binaryio_writer *record);
+
+/*
+Stores the record of the len byte block at block, evicting old entries if the cache outgrows
+its cap. Failing to store an entry is not an error: the block just won't hit next time.
+*/
+void block_cache_put(block_cache *c, const unsigned char *block, size_t len, const binaryio_writer *record);
+
+// Upper bound on the bytes a cache allocates for reading entries.
+size_t block_cache_memory();
+
+// Writes a one line summary of the lookups and evictions so far to f.
+void block_cache_report(block_cache *c, const char *name, FILE *f);
+
+// Frees a cache. The entries stay on disk.
+void block_cache_free(block_cache *c);
+
+#endif
@@ -1,92 +1,557 @@
 #include "compress.h"
 #include "binaryIO.h"
+#include "format.h"
 #include "string_table.h"
+#include "verify.h"
+#include "governor.h"
+#include "cache.h"
+#include "arena.h"
+#include "trace.h"
 #include <limits.h>
-#define ASCII_CHAR_MAX 256
+#include <math.h>
 
-void compress(int max_bits) {
+/*Blocks whose sampled entropy is at least this many bits per byte are stored instead of LZW coded.
+LZW spends at least 9 bits per phrase, so on data this close to random the phrases stay
+around one byte long and coding them expands the block.*/
+#define STORED_ENTROPY_THRESHOLD 7.5
 
-    size_t max_size = 1 << max_bits; // Max size of string table.
+// The entropy estimate looks at ENTROPY_SAMPLE_SLICES evenly spaced slices of a block.
+#define ENTROPY_SAMPLE_SLICES 16
+#define ENTROPY_SLICE_SIZE 256
 
-    /*Pruning only occurs when MAXBITS is greater than 10 to minimize compression time
-    on small string tables.*/
-    int prune = (max_bits > 10) ? 1 : 0;
+/*Estimates the order-0 entropy of a block, in bits per byte, from an evenly spaced sample.
+The byte histogram is split over four sets of counters so that neighbouring bytes never
+increment the same counter, which keeps the loop from stalling on its own stores.*/
+double __block_entropy(const unsigned char *data, size_t len) {
+    uint32_t counts[4][ASCII_CHAR_MAX] = {{0}};
+    size_t sampled = 0;
+
+    size_t slices = ENTROPY_SAMPLE_SLICES;
+    size_t slice_size = ENTROPY_SLICE_SIZE;
+    if (len <= slices * slice_size) { // small blocks are sampled completely
+        slices = 1;
+        slice_size = len;
+    }
+    size_t stride = len / slices;
+
+    for (size_t s = 0; s < slices; s++) {
+        const unsigned char *slice = data + s * stride;
+        size_t i = 0;
+        for (; i + 4 <= slice_size; i += 4) {
+            counts[0][slice[i]]++;
+            counts[1][slice[i + 1]]++;
+            counts[2][slice[i + 2]]++;
+            counts[3][slice[i + 3]]++;
+        }
+        for (; i < slice_size; i++)
+            counts[0][slice[i]]++;
+        sampled += slice_size;
+    }
+
+    double entropy = 0;
+    for (int c = 0; c < ASCII_CHAR_MAX; c++) {
+        uint32_t count = counts[0][c] + counts[1][c] + counts[2][c] + counts[3][c];
+        if (count) {
+            double p = (double) count / sampled;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy;
+}
+
+/*Whether a block looks random enough to be stored verbatim instead of LZW coded.*/
+int __block_looks_random(const unsigned char *data, size_t len) {
+    return __block_entropy(data, len) >= STORED_ENTROPY_THRESHOLD;
+}
+
+/*Returns the length of the run of data[0] at the start of data, looking at no more than len bytes.
+Bytes are compared eight at a time by XOR-ing whole words against the repeated byte,
+and non-runs are rejected after a single word.*/
+size_t __run_length(const unsigned char *data, size_t len) {
+    uint64_t pattern = 0x0101010101010101ULL * data[0];
+    size_t run = 0;
+
+    while (run + sizeof(uint64_t) <= len) {
+        uint64_t word;
+        memcpy(&word, data + run, sizeof(uint64_t));
+        uint64_t diff = word ^ pattern;
+
+        // the first differing byte ends the run (words are loaded little-endian)
+        if (diff)
+            return run + (__builtin_ctzll(diff) / CHAR_BIT);
+        run += sizeof(uint64_t);
+    }
 
-    binaryio_buffer b_buf = {.buffer = 0, .size = 0}; 
-    int cur_bits = 9; // How many bits we need to represent each code.
-    int cur_max = 1 << cur_bits;
+    while (run < len && data[run] == data[0])
+        run++;
+    return run;
+}
 
-    // We represent max bits with 5 bits
-    binary_write(stdout, &b_buf, max_bits, 5, 0); 
+/*Writes a block header to out.*/
+void __write_block_header(binaryio_writer *out, int type, size_t raw_size, size_t payload_size) {
+    unsigned char header[BLOCK_HEADER_SIZE];
+    block_header_pack(&(block_header) {
+        .type = type,
+        .raw_size = raw_size,
+        .payload_size = payload_size
+    }, header);
 
-    compression_strtable *str_table = compression_strtable_new(max_size); 
+    binaryio_writer_put_bytes(out, header, BLOCK_HEADER_SIZE);
+}
 
+/*Fills an empty table with the codes every string table starts with.*/
+void __lzw_encoder_init_table(compression_strtable *table) {
     // We first initialize the ASCII characters into the table.
     for (int i = 0; i < ASCII_CHAR_MAX; i++) {
-        compression_strtable_insert(str_table, -1, i);
+        compression_strtable_insert(table, -1, i);
+    }
+    // The placeholder for the run token is never matched since no byte equals RUN_CODE.
+    compression_strtable_insert(table, -1, RUN_CODE);
+}
+
+/*Prunes one compression table into another, for the pruner thread.*/
+void __prune_compression_strtable(void *original, void *pruned) {
+    compression_strtable_prune(original, pruned);
+}
+
+lzw_encoder *lzw_encoder_new(int max_bits, int flags) {
+    lzw_encoder *encoder = malloc(sizeof(lzw_encoder));
+    encoder->max_bits = max_bits;
+
+    /*Pruning only occurs when MAXBITS is greater than 10 to minimize compression time
+    on small string tables.*/
+    encoder->prune = (max_bits > 10) ? 1 : 0;
+    encoder->cur_bits = MIN_CODE_BITS;
+
+    encoder->table = compression_strtable_new((size_t) 1 << max_bits);
+    encoder->spare = encoder->prune ? compression_strtable_new((size_t) 1 << max_bits) : NULL;
+    __lzw_encoder_init_table(encoder->table);
+
+    encoder->pruner = (encoder->prune && (flags & STREAM_FLAG_ASYNC_PRUNE)) ? pruner_new(__prune_compression_strtable) : NULL;
+    encoder->install_countdown = 0;
+
+    return encoder;
+}
+
+void lzw_encoder_reset(lzw_encoder *encoder) {
+    // a background prune still reads the table, and its result is no longer wanted
+    if (encoder->install_countdown > 0) {
+        pruner_wait(encoder->pruner);
+        encoder->install_countdown = 0;
+    }
+
+    encoder->cur_bits = MIN_CODE_BITS;
+    compression_strtable_reset(encoder->table);
+    __lzw_encoder_init_table(encoder->table);
+}
+
+/*Called after every code the encoder writes. If the table is full it gets pruned,
+otherwise (code, character) is added, where character is the byte that ended the match.
+A character of -1 means the code ended the block, in which case nothing is added.
+The decoder makes the same decision after reading each code.*/
+void __lzw_encoder_update(lzw_encoder *encoder, int code, int character) {
+    compression_strtable *table = encoder->table;
+
+    /*While a background prune runs, the full table is frozen and nothing is added.
+    The pruned table takes over a fixed number of codes later, where the decoder switches too.*/
+    if (encoder->install_countdown > 0) {
+        if (--encoder->install_countdown == 0) {
+            TRACE_SPAN_BEGIN(wait_start);
+            pruner_wait(encoder->pruner);
+            TRACE_SPAN_END(wait_start, "prune_install_wait", 0);
+            encoder->table = encoder->spare;
+            encoder->spare = table;
+        }
+    }
+    else if (encoder->prune && table->size >= table->max_size) {
+        if (encoder->pruner != NULL) {
+            TRACE_INSTANT("prune_start", table->size);
+            pruner_start(encoder->pruner, table, encoder->spare);
+            encoder->install_countdown = table->max_size >> PRUNE_INSTALL_SHIFT;
+        }
+        else {
+            TRACE_SPAN_BEGIN(prune_start);
+            compression_strtable_prune(table, encoder->spare);
+            encoder->table = encoder->spare;
+            encoder->spare = table;
+            TRACE_SPAN_END(prune_start, "compression_strtable_prune", encoder->table->size);
+        }
+    }
+    else if (character != -1) {
+        compression_strtable_insert(table, code, character);
     }
+}
+
+/*Writes a code (or the run token) using the width the decoder will expect for it.*/
+static inline void __lzw_encoder_put(lzw_encoder *encoder, binaryio_writer *out, int code) {
+    int bits = lzw_code_bits(encoder->table->size, encoder->max_bits);
+
+#ifdef LZW_TRACE
+    if (bits != encoder->cur_bits) {
+        TRACE_INSTANT("code_bits", bits);
+        encoder->cur_bits = bits;
+    }
+#endif
+
+    binaryio_writer_put(out, code, bits);
+}
+
+/*Progress of one encoder through its slice of a block.*/
+struct lzw_encode_cursor {
+    lzw_encoder *encoder;
+    binaryio_writer *out;
+
+    const unsigned char *in;
+    size_t len;
+    size_t i; // next byte to code
 
     // We'll represent code = -1 as the empty string.
     // If we use 0, we get problems with binary files.
-    int code = -1;
-    int character;
+    int code;
+};
 
-    while ((character = getchar()) != EOF) {
-        strtable_entry *match = compression_strtable_get(str_table, code, character); 
+typedef struct lzw_encode_cursor lzw_encode_cursor;
 
-        // Checks if given (prefix, character) is in hash table.
-        if (match != NULL) {
-            code = match->code;
-        }
+/*Advances a cursor by one byte of input: either starts a new phrase (possibly
+with a run token) or probes the string table with the next byte.*/
+static inline void __lzw_encode_step(lzw_encode_cursor *cur) {
+    lzw_encoder *encoder = cur->encoder;
+    const unsigned char *in = cur->in;
+
+    // At the start of every phrase we check for a run of a single byte,
+    // which is cheaper to write as one run token than to grow through the table.
+    if (cur->code == -1) {
+        size_t left = cur->len - cur->i;
+        size_t run = __run_length(in + cur->i, (left < RUN_MAX_LENGTH) ? left : RUN_MAX_LENGTH);
 
+        if (run >= RUN_MIN_LENGTH) {
+            __lzw_encoder_put(encoder, cur->out, RUN_CODE);
+            binaryio_writer_put(cur->out, in[cur->i], CHAR_BIT);
+            binaryio_writer_put(cur->out, run - RUN_MIN_LENGTH, RUN_LENGTH_BITS);
+            cur->i += run;
+        }
         else {
-            // If we need to represent codes with more bits.
-            if (str_table->size >= cur_max && cur_bits < max_bits) {
-                cur_bits++;
-                cur_max *= 2; 
-            }
+            // The single character strings always keep codes 0-255, even across prunes.
+            cur->code = in[cur->i++];
+        }
+        return;
+    }
+
+    int character = in[cur->i];
+    strtable_entry *match = compression_strtable_get(encoder->table, cur->code, character);
+
+    // Checks if given (prefix, character) is in hash table.
+    if (match != NULL) {
+        cur->code = match->code;
+        cur->i++;
+        return;
+    }
+
+    __lzw_encoder_put(encoder, cur->out, cur->code);
+    __lzw_encoder_update(encoder, cur->code, character);
+
+    // The next phrase starts at the character that ended this one.
+    cur->code = -1;
+}
+
+/*Writes the last pending code of a cursor's slice and pads its output to a byte boundary.*/
+void __lzw_encode_finish(lzw_encode_cursor *cur) {
+    lzw_encoder *encoder = cur->encoder;
+
+    // If we need to print out another code we do.
+    if (cur->code != -1) {
+        __lzw_encoder_put(encoder, cur->out, cur->code);
+        __lzw_encoder_update(encoder, cur->code, -1);
+    }
+    binaryio_writer_flush(cur->out);
+}
+
+void lzw_encoder_encode(lzw_encoder *encoder, const unsigned char *in, size_t len, binaryio_writer *out) {
+    lzw_encode_cursor cur = {.encoder = encoder, .out = out, .in = in, .len = len, .i = 0, .code = -1};
+
+    while (cur.i < cur.len)
+        __lzw_encode_step(&cur);
+    __lzw_encode_finish(&cur);
+}
+
+void lzw_encoder_encode_streams(lzw_encoder **encoders, int streams, const unsigned char *in, size_t len, binaryio_writer **outs) {
+    if (streams == 1) {
+        lzw_encoder_encode(encoders[0], in, len, outs[0]);
+        return;
+    }
+
+    lzw_encode_cursor cursors[MAX_STREAMS];
+    for (int s = 0; s < streams; s++) {
+        size_t start = block_stream_offset(len, streams, s);
+        cursors[s] = (lzw_encode_cursor) {
+            .encoder = encoders[s],
+            .out = outs[s],
+            .in = in + start,
+            .len = block_stream_offset(len, streams, s + 1) - start,
+            .i = 0,
+            .code = -1
+        };
+    }
 
-            binary_write(stdout, &b_buf, code, cur_bits, 0); 
-
-            // If the table is full, we prune.
-            if (prune && str_table->size >= str_table->max_size) {
-                compression_strtable *pruned_table = compression_strtable_prune(str_table);
-                compression_strtable *original = str_table;
-                compression_strtable_free(original);
-                str_table = pruned_table;
-
-                // Now we figure out how many bits to represent codes with.
-                int cur_size = str_table->size; 
-                int new_bits = 0;
-                while (cur_size) {
-                    cur_size >>= 1; 
-                    new_bits++; 
-                }
-                cur_bits = new_bits;
-                cur_max = 1 << cur_bits; 
+    /*The sub-streams take turns coding one byte each. After its turn, a cursor prefetches
+    the bucket of its next probe, which then has a whole round to arrive from memory.*/
+    int active = streams;
+    while (active) {
+        active = 0;
+        for (int s = 0; s < streams; s++) {
+            lzw_encode_cursor *cur = &cursors[s];
+            if (cur->i >= cur->len)
+                continue;
 
+            __lzw_encode_step(cur);
+            if (cur->i < cur->len) {
+                active++;
+                if (cur->code != -1)
+                    compression_strtable_prefetch(cur->encoder->table, cur->code, cur->in[cur->i]);
             }
+        }
+    }
+
+    for (int s = 0; s < streams; s++)
+        __lzw_encode_finish(&cursors[s]);
+}
+
+void lzw_encoder_free(lzw_encoder *encoder) {
+    if (encoder->pruner != NULL)
+        pruner_free(encoder->pruner);
+    compression_strtable_free(encoder->table);
+    if (encoder->spare != NULL)
+        compression_strtable_free(encoder->spare);
+    free(encoder);
+}
+
+compress_context *compress_context_new(int max_bits, int streams, int flags) {
+    compress_context *ctx = malloc(sizeof(compress_context));
+    ctx->max_bits = max_bits;
+    ctx->streams = streams;
+    ctx->flags = flags;
+
+    // the writers get room for the largest block up front, so they never grow while coding
+    for (int s = 0; s < streams; s++) {
+        ctx->encoders[s] = lzw_encoder_new(max_bits, flags);
+        ctx->outs[s] = binaryio_writer_new();
+        binaryio_writer_reserve(ctx->outs[s], BLOCK_PAYLOAD_MAX);
+    }
+    ctx->record = binaryio_writer_new();
+    binaryio_writer_reserve(ctx->record, BLOCK_HEADER_SIZE + BLOCK_PAYLOAD_MAX);
+
+    return ctx;
+}
+
+void compress_context_reset(compress_context *ctx) {
+    for (int s = 0; s < ctx->streams; s++)
+        lzw_encoder_reset(ctx->encoders[s]);
+}
+
+void compress_stream_header(compress_context *ctx, binaryio_writer *out) {
+    unsigned char header[STREAM_HEADER_SIZE];
+    stream_header_pack(&(stream_header) {.max_bits = ctx->max_bits, .flags = ctx->flags, .streams = ctx->streams}, header);
+    binaryio_writer_put_bytes(out, header, STREAM_HEADER_SIZE);
+}
+
+binaryio_writer *compress_block(compress_context *ctx, const unsigned char *block, size_t len) {
+    binaryio_writer *record = ctx->record;
+    binaryio_writer_reset(record);
+
+    // Blocks that look random are copied through untouched,
+    // which skips the hash table entirely and never expands them.
+    if (__block_looks_random(block, len)) {
+        TRACE_INSTANT("stored_block", len);
+        __write_block_header(record, BLOCK_STORED, len, len);
+        binaryio_writer_put_bytes(record, block, len);
+        return record;
+    }
+
+    int streams = ctx->streams;
+    for (int s = 0; s < streams; s++)
+        binaryio_writer_reset(ctx->outs[s]);
+    if (ctx->flags & STREAM_FLAG_INDEPENDENT)
+        compress_context_reset(ctx);
+
+    TRACE_SPAN_BEGIN(encode_start);
+    lzw_encoder_encode_streams(ctx->encoders, streams, block, len, ctx->outs);
+    TRACE_SPAN_END(encode_start, "lzw_encode", len);
+
+    size_t payload_size = 4 * (streams - 1);
+    for (int s = 0; s < streams; s++)
+        payload_size += ctx->outs[s]->size;
+    __write_block_header(record, BLOCK_LZW, len, payload_size);
+
+    // The payload starts with the sizes of all but the last sub-stream.
+    for (int s = 0; s < streams - 1; s++) {
+        unsigned char size[4];
+        pack_u32(ctx->outs[s]->size, size);
+        binaryio_writer_put_bytes(record, size, 4);
+    }
+    for (int s = 0; s < streams; s++)
+        binaryio_writer_put_bytes(record, ctx->outs[s]->data, ctx->outs[s]->size);
+
+    return record;
+}
+
+void compress_stream_end(binaryio_writer *out) {
+    __write_block_header(out, BLOCK_END, 0, 0);
+}
+
+void compress_buffer(compress_context *ctx, const unsigned char *in, size_t len, binaryio_writer *out) {
+    compress_stream_header(ctx, out);
+
+    for (size_t offset = 0; offset < len; offset += BLOCK_SIZE) {
+        size_t block_len = (len - offset < BLOCK_SIZE) ? len - offset : BLOCK_SIZE;
+        binaryio_writer *record = compress_block(ctx, in + offset, block_len);
+        binaryio_writer_put_bytes(out, record->data, record->size);
+    }
+
+    compress_stream_end(out);
+}
+
+void compress_context_free(compress_context *ctx) {
+    for (int s = 0; s < ctx->streams; s++) {
+        binaryio_writer_free(ctx->outs[s]);
+        lzw_encoder_free(ctx->encoders[s]);
+    }
+    binaryio_writer_free(ctx->record);
+    free(ctx);
+}
 
-            compression_strtable_insert(str_table, code, character);
-    
-            strtable_entry* entry = compression_strtable_get(str_table, -1, character);
-            code = (entry != NULL) ? entry->code : -1;
+size_t compress_memory(int max_bits, int streams, int verify, int cache) {
+    // every encoder that prunes has a second table to prune into
+    size_t tables = streams * (max_bits > 10 ? 2 : 1) * compression_strtable_memory((size_t) 1 << max_bits);
+    // the block, the per sub-stream outputs and the record all hold at most a block's payload
+    size_t buffers = BLOCK_SIZE + (streams + 1) * (BLOCK_HEADER_SIZE + BLOCK_PAYLOAD_MAX);
+
+    return tables + buffers + (verify ? verifier_memory(max_bits, streams) : 0) + (cache ? block_cache_memory() : 0);
+}
+
+/*Picks the largest max_bits up to the requested one whose tables and buffers fit in the
+memory budget, or MAX_BITS_LB if none do.*/
+int __fit_max_bits(const compress_options *options) {
+    int max_bits = options->max_bits;
+    if (options->max_memory == 0)
+        return max_bits;
+
+    int streams = options->streams, verify = options->verify, cache = options->cache_dir != NULL;
+    while (max_bits > MAX_BITS_LB && compress_memory(max_bits, streams, verify, cache) > options->max_memory)
+        max_bits--;
+
+    if (compress_memory(max_bits, streams, verify, cache) > options->max_memory)
+        fprintf(stderr, "compress: even MAXBITS=%d needs %zu bytes, more than the memory limit\n",
+            max_bits, compress_memory(max_bits, streams, verify, cache));
+    else if (max_bits < options->max_bits)
+        fprintf(stderr, "compress: running with MAXBITS=%d to stay within the memory limit\n", max_bits);
+
+    return max_bits;
+}
+
+int compress(const compress_options *options) {
+
+    int max_bits = __fit_max_bits(options);
+    int flags = (options->async_prune ? STREAM_FLAG_ASYNC_PRUNE : 0)
+        | (options->independent || options->cache_dir != NULL ? STREAM_FLAG_INDEPENDENT : 0);
+
+    block_cache *cache = NULL;
+    if (options->cache_dir != NULL) {
+        cache = block_cache_new(options->cache_dir, options->cache_size, max_bits, options->streams, flags);
+        if (cache == NULL)
+            return -1;
+    }
+
+    compress_context *ctx = compress_context_new(max_bits, options->streams, flags);
+    verifier *v = options->verify ? verifier_new(max_bits, options->streams, flags) : NULL;
+    governor *g = (options->max_rate > 0 || options->cpu_share > 0) ? governor_new(options->max_rate, options->cpu_share) : NULL;
+    binaryio_writer *header = binaryio_writer_new();
+    arena *buffers = arena_new(BLOCK_SIZE);
+    unsigned char *block = arena_alloc(buffers, BLOCK_SIZE);
+    size_t len;
+    int status = 0;
+
+#ifdef LZW_FAULT_INJECTION
+    // For testing --verify: LZW_CORRUPT_BLOCK=N flips a bit in the payload of block N, counting
+    // from 0, after it was coded, as a bug in the encoder would. Only tests/fault/compress has this.
+    const char *corrupt = getenv("LZW_CORRUPT_BLOCK");
+    long corrupt_block = (corrupt != NULL) ? atol(corrupt) : -1;
+    long block_index = 0;
+#endif
+
+    compress_stream_header(ctx, header);
+    fwrite(header->data, 1, header->size, stdout);
+
+    while (1) {
+        TRACE_SPAN_BEGIN(read_start);
+        len = fread(block, 1, BLOCK_SIZE, stdin);
+        TRACE_SPAN_END(read_start, "read", len);
+        if (len == 0)
+            break;
+
+        // a cached record is exactly what coding the block would give, so it is verified all the same.
+        // Stored blocks are copied faster than they are looked up, so only LZW blocks are cached.
+        binaryio_writer *record = ctx->record;
+        int cached = cache != NULL && !__block_looks_random(block, len);
+        if (!cached || !block_cache_get(cache, block, len, record)) {
+            record = compress_block(ctx, block, len);
+            if (cached)
+                block_cache_put(cache, block, len, record);
         }
 
+#ifdef LZW_FAULT_INJECTION
+        if (block_index++ == corrupt_block && record->size > BLOCK_HEADER_SIZE)
+            record->data[BLOCK_HEADER_SIZE + (record->size - BLOCK_HEADER_SIZE) / 2] ^= 0x10;
+#endif
 
+        // The verifier reports a mismatch on the next submit, so we stop within a few blocks of it.
+        if (v != NULL && verifier_submit(v, block, len, record->data, record->size) != 0) {
+            status = -1;
+            break;
+        }
+
+        TRACE_SPAN_BEGIN(write_start);
+        fwrite(record->data, 1, record->size, stdout);
+        TRACE_SPAN_END(write_start, "write", record->size);
+
+        if (g != NULL) {
+            // we flush first, so that a paced stream also reaches its reader at the paced rate
+            fflush(stdout);
+            governor_pace(g, len);
+        }
+    }
+
+    if (v != NULL) {
+        if (verifier_finish(v) != 0) {
+            fprintf(stderr, "compress: verification failed in the block at input offset %zu\n", v->failed_offset);
+            status = -1;
+        }
+        verifier_free(v);
+    }
+
+    // A stream that failed verification is left without its end block, so it can't be mistaken for a good one.
+    if (status == 0) {
+        binaryio_writer_reset(header);
+        compress_stream_end(header);
+        fwrite(header->data, 1, header->size, stdout);
+    }
+
+    if (g != NULL) {
+        governor_report(g, "compress", stderr);
+        governor_free(g);
     }
-    // If we need to print out another code we do, flushing at the end.
-    if (code != -1) 
-        binary_write(stdout, &b_buf, code, cur_bits, 1); 
-    // Otherwise we flush the buffer.
-    else
-        binaryio_buffer_write(stdout, &b_buf);
-    
+
+    if (cache != NULL) {
+        block_cache_report(cache, "compress", stderr);
+        block_cache_free(cache);
+    }
+
     // For debugging.
     if (getenv("DBG") != NULL && strcmp(getenv("DBG"), "1") == 0)
-        compression_strtable_dump(str_table, "./DBG.compress");
-
-    compression_strtable_free(str_table);
+        compression_strtable_dump(ctx->encoders[0]->table, "./DBG.compress");
 
+    arena_free(buffers);
+    binaryio_writer_free(header);
+    compress_context_free(ctx);
 
-}
\ No newline at end of file
+    return status;
+}
@@ -1,11 +1,140 @@
 #ifndef COMPRESS
 #define COMPRESS
+#include <stddef.h>
+#include "binaryIO.h"
+#include "pruner.h"
+#include "string_table.h"
+#include "format.h"
+
 /*
-Compresses a stream passed into stdin using the Lempel-Ziv-Welch (LZW) algorithm.
-Args:
-    `int max_bits`: the number of bits to represent the largest entry in the string table.
+State of an LZW encoder. The string table is carried over from one block to the next,
+so consecutive blocks share one dictionary.
+*/
+struct lzw_encoder {
+    compression_strtable *table;
+    compression_strtable *spare; // what table is pruned into, if the encoder prunes
+    int max_bits;
+    int prune; // whether the table is pruned when it fills up
+
+    pruner *pruner; // prunes in the background with STREAM_FLAG_ASYNC_PRUNE, otherwise NULL
+    size_t install_countdown; // codes left until a background prune is installed, 0 if none is running
+    int cur_bits; // width of the last code written, only tracked for tracing
+};
+
+typedef struct lzw_encoder lzw_encoder;
+
+/*
+Constructs a new encoder whose string table holds at most 2^`max_bits` codes, for a stream
+with the given STREAM_FLAG_* flags.
+The returned encoder is dynamically allocated and therefore must be freed.
+*/
+lzw_encoder *lzw_encoder_new(int max_bits, int flags);
+
+// Returns an encoder to the state it had right after construction, reusing its memory.
+void lzw_encoder_reset(lzw_encoder *encoder);
+
+/*
+LZW codes the `len` bytes at `in`, appending the codes to `out`.
+The output is padded to a byte boundary, so every block can be decoded on its own
+given the string table left behind by the previous blocks.
+*/
+void lzw_encoder_encode(lzw_encoder *encoder, const unsigned char *in, size_t len, binaryio_writer *out);
+
+/*
+Codes a block split into `streams` sub-streams, where sub-stream i is coded by `encoders[i]`
+into `outs[i]`. The encoders advance through their slices in lock-step, so the hash table
+probes of the different sub-streams overlap instead of waiting on each other.
+*/
+void lzw_encoder_encode_streams(lzw_encoder **encoders, int streams, const unsigned char *in, size_t len, binaryio_writer **outs);
+
+// Frees an encoder and its string table.
+void lzw_encoder_free(lzw_encoder *encoder);
+
+/*
+Everything needed to compress a stream: one encoder per sub-stream plus the buffers
+blocks are assembled in. A context can be reset and reused for any number of streams.
+*/
+struct compress_context {
+    int max_bits;
+    int streams;
+    int flags;
+
+    lzw_encoder *encoders[MAX_STREAMS];
+    binaryio_writer *outs[MAX_STREAMS]; // per sub-stream output of the current block
+    binaryio_writer *record; // the current block, header included
+};
+
+typedef struct compress_context compress_context;
+
+/*
+Constructs a new compression context for streams with the given STREAM_FLAG_* flags.
+The returned context is dynamically allocated and therefore must be freed.
+*/
+compress_context *compress_context_new(int max_bits, int streams, int flags);
+
+// Resets the string tables of a context so it can start a new stream.
+void compress_context_reset(compress_context *ctx);
+
+// Appends the stream header for a context's settings to out.
+void compress_stream_header(compress_context *ctx, binaryio_writer *out);
+
+/*
+Compresses one block of at most BLOCK_SIZE bytes. The returned writer holds the complete
+block (header and payload); it belongs to the context and is overwritten by the next call.
+*/
+binaryio_writer *compress_block(compress_context *ctx, const unsigned char *block, size_t len);
+
+// Appends the header that terminates a stream to out.
+void compress_stream_end(binaryio_writer *out);
+
+// Compresses the len bytes at in as one complete stream, appending it to out.
+void compress_buffer(compress_context *ctx, const unsigned char *in, size_t len, binaryio_writer *out);
+
+// Frees a context and everything it holds.
+void compress_context_free(compress_context *ctx);
+
+/*
+Upper bound on the bytes `compress()` allocates for string tables and buffers with the
+given settings, with verification if `verify` is set and a block cache if `cache` is set.
+*/
+size_t compress_memory(int max_bits, int streams, int verify, int cache);
+
+/*
+Settings for `compress()`.
+    `max_bits`: the number of bits to represent the largest entry in the string table.
     This has the effect of setting the maximum size of the string table to be 2^`max_bits`.
+    `streams`: the number of independently coded sub-streams per block (1 to MAX_STREAMS).
+    `verify`: whether every block is decoded again on a second thread and checked against the input.
+    `async_prune`: whether full string tables are pruned in the background (STREAM_FLAG_ASYNC_PRUNE).
+    `independent`: whether every block is coded with fresh string tables (STREAM_FLAG_INDEPENDENT).
+    `cache_dir`, `cache_size`: a block cache directory and its size cap in bytes, see cache.h (NULL for none).
+    A cache implies `independent`.
+    `max_rate`, `cpu_share`: limits on throughput and CPU use, see governor.h (0 for none).
+    `max_memory`: a limit on `compress_memory`, met by lowering `max_bits` as needed (0 for none).
+*/
+struct compress_options {
+    int max_bits;
+    int streams;
+    int verify;
+    int async_prune;
+    int independent;
+
+    const char *cache_dir;
+    size_t cache_size;
+
+    double max_rate;
+    double cpu_share;
+    size_t max_memory;
+};
+
+typedef struct compress_options compress_options;
+
+/*
+Compresses a stream passed into stdin using the Lempel-Ziv-Welch (LZW) algorithm.
+The input is split into blocks; blocks that look incompressible are stored as is.
+Returns 0 on success, or -1 if verification was requested and a block didn't round-trip,
+in which case compression stops at that block, or if the cache directory can't be used.
 */
-void compress(int max_bits);
+int compress(const compress_options *options);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,124 +1,463 @@
 #include "decompress.h"
 #include "string_table.h"
-#include "stack.h"
 #include "stdio.h"
 #include "binaryIO.h"
-#define ASCII_CHAR_MAX 256
-#define MAX_BITS_DEFAULT 12
+#include "format.h"
+#include "trace.h"
+#include "arena.h"
 
-void decompress() {
-
-    int max_bits = MAX_BITS_DEFAULT;
+/*Fills an empty table with the codes every string table starts with.*/
+void __lzw_decoder_init_table(decompression_strtable *table) {
+    // Initializes 8-bit characters to the string table.
+    for (int i = 0; i < ASCII_CHAR_MAX; i++) {
+        decompression_strtable_insert(table, -1, i);
+    }
+    // Placeholder for the run token, matching the encoder's table.
+    decompression_strtable_insert(table, -1, RUN_CODE);
+}
 
-    binaryio_buffer b_buf = {.buffer = 0, .size = 0}; 
-    int cur_bits = 9;
-    int cur_max = 1 << 9; 
+/*Prunes one decompression table into another, for the pruner thread.*/
+void __prune_decompression_strtable(void *original, void *pruned) {
+    decompression_strtable_prune(original, pruned);
+}
 
-    // We first get the max bits.
-    binary_read(stdin, &b_buf, &max_bits, 5);
+lzw_decoder *lzw_decoder_new(int max_bits, int flags) {
+    lzw_decoder *decoder = malloc(sizeof(lzw_decoder));
+    decoder->max_bits = max_bits;
 
     /*Pruning only occurs when MAXBITS is greater than 10 to minimize compression time
     on small string tables.*/
-    int prune = (max_bits > 10) ? 1 : 0;
+    decoder->prune = (max_bits > 10) ? 1 : 0;
+    decoder->cur_bits = MIN_CODE_BITS;
 
-    // Max size for the string table.
-    int max_size = 1 << max_bits; 
+    decoder->table = decompression_strtable_new((size_t) 1 << max_bits);
+    decoder->spare = decoder->prune ? decompression_strtable_new((size_t) 1 << max_bits) : NULL;
+    __lzw_decoder_init_table(decoder->table);
 
-    decompression_strtable *table = decompression_strtable_new(max_size); 
+    decoder->pruner = (decoder->prune && (flags & STREAM_FLAG_ASYNC_PRUNE)) ? pruner_new(__prune_decompression_strtable) : NULL;
+    decoder->install_countdown = 0;
 
-    // Initializes 8-bit characters to the string table.
-    for (int i = 0; i < ASCII_CHAR_MAX; i++) {
-        decompression_strtable_insert(table, -1, i);
+    return decoder;
+}
+
+void lzw_decoder_reset(lzw_decoder *decoder) {
+    // a background prune still reads the table, and its result is no longer wanted
+    if (decoder->install_countdown > 0) {
+        pruner_wait(decoder->pruner);
+        decoder->install_countdown = 0;
     }
 
-    stack *char_stack = stack_new(); 
+    decoder->cur_bits = MIN_CODE_BITS;
+    decompression_strtable_reset(decoder->table);
+    __lzw_decoder_init_table(decoder->table);
+}
 
-    int old_code = -1; // -1 represents EMPTY
-    int next_code; 
-    int code; 
+int lzw_decoder_update(lzw_decoder *decoder) {
+    decompression_strtable *table = decoder->table;
 
-    /*Code reading occurs after pruning,
-    to ensure synchronization between encode and decode string tables.
-    This results in a while True loop with a break.*/
-    while (1) { 
+    if (decoder->install_countdown > 0) {
+        if (--decoder->install_countdown == 0) {
+            TRACE_SPAN_BEGIN(wait_start);
+            pruner_wait(decoder->pruner);
+            TRACE_SPAN_END(wait_start, "prune_install_wait", 0);
+            decoder->table = decoder->spare;
+            decoder->spare = table;
+        }
+        return 0;
+    }
 
-        if (prune && table->size >= table->max_size) {
-            decompression_strtable *pruned_table = decompression_strtable_prune(table);
-            decompression_strtable *original = table;
-            table = pruned_table;
-            decompression_strtable_free(original);
-    
-            // We may be able to represent codes
-            // with less bits now, so we check for that.
-            int cur_size = table->size; 
-            int new_bits = 0;
-            while (cur_size) {
-                cur_size >>= 1; 
-                new_bits++; 
-            }
-            cur_bits = new_bits;
-            cur_max = 1 << cur_bits; 
-            if (table->size + 1 == cur_max) {
-                cur_bits++;
-                cur_max *= 2; 
-            }
-    
+    /*Our table now matches the encoder's at the time it wrote the code,
+    so we prune exactly when it did.*/
+    if (decoder->prune && table->size >= table->max_size) {
+        if (decoder->pruner != NULL) {
+            TRACE_INSTANT("prune_start", table->size);
+            pruner_start(decoder->pruner, table, decoder->spare);
+            decoder->install_countdown = table->max_size >> PRUNE_INSTALL_SHIFT;
+        }
+        else {
+            TRACE_SPAN_BEGIN(prune_start);
+            decompression_strtable_prune(table, decoder->spare);
+            decoder->table = decoder->spare;
+            decoder->spare = table;
+            TRACE_SPAN_END(prune_start, "decompression_strtable_prune", decoder->table->size);
         }
-        int status = binary_read(stdin, &b_buf, &next_code, cur_bits);
+        return 0;
+    }
 
-        if (status != 1)
-            break;
+    return 1;
+}
 
-        code = next_code; 
+/*Progress of one decoder through its slice of a block.*/
+struct lzw_decode_cursor {
+    lzw_decoder *decoder;
+    binaryio_reader reader;
 
-        /*In the case of an unknown code, we find the final character
-        of the code and push it onto the stack.*/
-        if (code >= table->size) {
+    unsigned char *out;
+    size_t len;
+    size_t pos; // next byte to write
 
-            int temp = old_code;
-            while (table->arr[temp].prefix != -1) {
-                temp = table->arr[temp].prefix;
-            }
-            stack_push(char_stack, table->arr[temp].character);
+    int old_code; // -1 represents EMPTY
+    int next_code; // code read ahead of its expansion
+};
 
-            code = old_code;
-        }
+typedef struct lzw_decode_cursor lzw_decode_cursor;
+
+/*Reads the next code of a cursor's sub-stream into next_code.
+Returns 0 on success, or DECOMPRESS_ERR_TRUNCATED if the sub-stream has run out.*/
+static inline int __lzw_decode_read(lzw_decode_cursor *cur) {
+    decompression_strtable *table = cur->decoder->table;
+
+    /*The encoder's table is one entry ahead of ours whenever we still owe it
+    the entry for old_code, which we can only add once we know the next code.*/
+    int cur_bits = lzw_code_bits(table->size + (cur->old_code != -1), cur->decoder->max_bits);
 
-        while (table->arr[code].prefix != -1) {
-            stack_push(char_stack, table->arr[code].character); 
-            code = table->arr[code].prefix;
+#ifdef LZW_TRACE
+    if (cur_bits != cur->decoder->cur_bits) {
+        TRACE_INSTANT("code_bits", cur_bits);
+        cur->decoder->cur_bits = cur_bits;
+    }
+#endif
+
+    return binaryio_reader_get(&(cur->reader), &(cur->next_code), cur_bits) == 1 ? 0 : DECOMPRESS_ERR_TRUNCATED;
+}
+
+/*Expands next_code into the cursor's output and updates the string table.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the sub-stream is malformed.*/
+static inline int __lzw_decode_step(lzw_decode_cursor *cur) {
+    lzw_decoder *decoder = cur->decoder;
+    decompression_strtable *table = decoder->table;
+    int code = cur->next_code;
+
+    /*A run token stands for a run of one byte. The encoder added the entry we owe it
+    using the first byte of the run, and starts a new phrase after the run.*/
+    if (code == RUN_CODE) {
+        int run_char, run_length;
+        if (binaryio_reader_get(&(cur->reader), &run_char, CHAR_BIT) != 1
+            || binaryio_reader_get(&(cur->reader), &run_length, RUN_LENGTH_BITS) != 1)
+            return DECOMPRESS_ERR_TRUNCATED;
+
+        run_length += RUN_MIN_LENGTH;
+        if ((size_t) run_length > cur->len - cur->pos)
+            return DECOMPRESS_ERR_OVERRUN;
+
+        memset(cur->out + cur->pos, run_char, run_length);
+        cur->pos += run_length;
+
+        if (cur->old_code != -1)
+            decompression_strtable_insert(table, cur->old_code, run_char);
+        cur->old_code = -1;
+        return 0;
+    }
+
+    /*The only code not yet in our table that we can receive is the one the encoder added
+    right before writing it. Any other code means the block is corrupt, and expanding it
+    would walk off the table.*/
+    if (code < 0 || (size_t) code > table->size
+        || ((size_t) code == table->size && (cur->old_code == -1 || table->size >= table->max_size)))
+        return DECOMPRESS_ERR_CODE;
+
+    /*The entry we owe the encoder is old_code followed by the first byte of code. Adding
+    it first changes nothing for codes we already have, and supplies the unknown one,
+    whose first byte is old_code's.*/
+    if (cur->old_code != -1)
+        decompression_strtable_insert(table, cur->old_code, table->strings[(size_t) code == table->size ? cur->old_code : code].first);
+
+    /*The string's length bounds its expansion, so one check covers all of it, and we write it
+    back to front while following its prefixes, with no end of chain test and no stack.*/
+    int length = table->strings[code].length;
+    if ((size_t) length > cur->len - cur->pos)
+        return DECOMPRESS_ERR_OVERRUN;
+
+    unsigned char *start = cur->out + cur->pos;
+    unsigned char *p = start + length;
+    const strtable_entry *arr = table->arr;
+    for (int c = code; p > start; c = arr[c].prefix)
+        *--p = arr[c].character;
+    cur->pos += length;
+
+    cur->old_code = lzw_decoder_update(decoder) ? code : -1;
+
+    return 0;
+}
+
+int lzw_decoder_decode(lzw_decoder *decoder, const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len) {
+    lzw_decode_cursor cur = {.decoder = decoder, .out = out, .len = out_len, .pos = 0, .old_code = -1};
+    binaryio_reader_init(&(cur.reader), in, in_len);
+
+    while (cur.pos < cur.len) { 
+        int status = __lzw_decode_read(&cur);
+        if (status == 0)
+            status = __lzw_decode_step(&cur);
+        if (status != 0)
+            return status;
+    }
+
+    return 0;
+}
+
+int lzw_decoder_decode_streams(lzw_decoder **decoders, int streams, const unsigned char **ins, const size_t *in_lens, unsigned char *out, size_t out_len) {
+    if (streams == 1)
+        return lzw_decoder_decode(decoders[0], ins[0], in_lens[0], out, out_len);
+
+    lzw_decode_cursor cursors[MAX_STREAMS];
+    int active = 0;
+
+    for (int s = 0; s < streams; s++) {
+        size_t start = block_stream_offset(out_len, streams, s);
+        lzw_decode_cursor *cur = &cursors[s];
+        *cur = (lzw_decode_cursor) {
+            .decoder = decoders[s],
+            .out = out + start,
+            .len = block_stream_offset(out_len, streams, s + 1) - start,
+            .pos = 0,
+            .old_code = -1
+        };
+        binaryio_reader_init(&(cur->reader), ins[s], in_lens[s]);
+
+        if (cur->len > 0) {
+            int status = __lzw_decode_read(cur);
+            if (status != 0)
+                return status;
+            active++;
         }
+    }
 
-        int final_char = table->arr[code].character; 
+    /*The sub-streams take turns expanding one code each. Each code is read a whole round
+    before it is expanded, and its table entry is prefetched right away, so the cache misses
+    of the different sub-streams are in flight at the same time.*/
+    while (active) {
+        active = 0;
+        for (int s = 0; s < streams; s++) {
+            lzw_decode_cursor *cur = &cursors[s];
+            if (cur->pos >= cur->len)
+                continue;
 
-        printf("%c", final_char); 
+            int status = __lzw_decode_step(cur);
+            if (status != 0)
+                return status;
 
-        while (char_stack->size > 0) {
-            int intermediate_char = stack_pop(char_stack); 
-            printf("%c", intermediate_char); 
+            if (cur->pos < cur->len) {
+                status = __lzw_decode_read(cur);
+                if (status != 0)
+                    return status;
+                __builtin_prefetch(&(cur->decoder->table->arr[cur->next_code]));
+                active++;
+            }
         }
+    }
 
-        // We add to the string table
-        // BUT, only if we have room for more codes.
-        if (old_code != -1) {
-            decompression_strtable_insert(table, old_code, final_char);
+    return 0;
+}
+
+void lzw_decoder_free(lzw_decoder *decoder) {
+    if (decoder->pruner != NULL)
+        pruner_free(decoder->pruner);
+    decompression_strtable_free(decoder->table);
+    if (decoder->spare != NULL)
+        decompression_strtable_free(decoder->spare);
+    free(decoder);
+}
+
+int decompress_split_streams(const unsigned char *payload, size_t payload_size, int streams, const unsigned char **ins, size_t *in_lens) {
+    size_t table_size = 4 * (streams - 1);
+    if (payload_size < table_size)
+        return DECOMPRESS_ERR_BLOCK;
+
+    size_t offset = table_size;
+    for (int s = 0; s < streams - 1; s++) {
+        in_lens[s] = unpack_u32(payload + 4 * s);
+        if (in_lens[s] > payload_size - offset)
+            return DECOMPRESS_ERR_BLOCK;
+        ins[s] = payload + offset;
+        offset += in_lens[s];
+    }
+    ins[streams - 1] = payload + offset;
+    in_lens[streams - 1] = payload_size - offset;
+
+    return 0;
+}
+
+decompress_context *decompress_context_new(int max_bits, int streams, int flags) {
+    decompress_context *ctx = malloc(sizeof(decompress_context));
+    ctx->max_bits = max_bits;
+    ctx->streams = streams;
+    ctx->flags = flags;
+
+    for (int s = 0; s < streams; s++)
+        ctx->decoders[s] = lzw_decoder_new(max_bits, flags);
+
+    return ctx;
+}
+
+void decompress_context_reset(decompress_context *ctx, int max_bits, int streams, int flags) {
+    // the tables have the wrong size or the decoders prune differently, so we start over
+    if (max_bits != ctx->max_bits || flags != ctx->flags) {
+        for (int s = 0; s < ctx->streams; s++)
+            lzw_decoder_free(ctx->decoders[s]);
+        ctx->streams = 0;
+        ctx->max_bits = max_bits;
+        ctx->flags = flags;
+    }
+
+    for (int s = 0; s < streams; s++) {
+        if (s < ctx->streams)
+            lzw_decoder_reset(ctx->decoders[s]);
+        else
+            ctx->decoders[s] = lzw_decoder_new(max_bits, flags);
+    }
+    for (int s = streams; s < ctx->streams; s++)
+        lzw_decoder_free(ctx->decoders[s]);
+
+    ctx->streams = streams;
+}
+
+int decompress_read_header(stream_header *header, const unsigned char *buf) {
+    stream_header_unpack(header, buf);
+
+    if (header->magic != ((STREAM_MAGIC_0 << 8) | STREAM_MAGIC_1))
+        return DECOMPRESS_ERR_HEADER;
+    if (header->version != STREAM_VERSION)
+        return DECOMPRESS_ERR_VERSION;
+    if (header->flags & ~STREAM_FLAGS_KNOWN)
+        return DECOMPRESS_ERR_FLAGS;
+    if (header->max_bits < MIN_CODE_BITS || header->max_bits > MAX_BITS_UB || header->streams < 1 || header->streams > MAX_STREAMS)
+        return DECOMPRESS_ERR_HEADER;
+    return 0;
+}
+
+int decompress_block(decompress_context *ctx, const block_header *header, const unsigned char *payload, unsigned char *out) {
+    const unsigned char *ins[MAX_STREAMS];
+    size_t in_lens[MAX_STREAMS];
+
+    if (header->raw_size > BLOCK_SIZE || header->payload_size > BLOCK_PAYLOAD_MAX)
+        return DECOMPRESS_ERR_BLOCK;
+
+    // Stored blocks go straight through without touching the string table.
+    if (header->type == BLOCK_STORED && header->payload_size == header->raw_size) {
+        memcpy(out, payload, header->raw_size);
+        return 0;
+    }
+
+    if (header->type != BLOCK_LZW || decompress_split_streams(payload, header->payload_size, ctx->streams, ins, in_lens) != 0)
+        return DECOMPRESS_ERR_BLOCK;
+
+    if (ctx->flags & STREAM_FLAG_INDEPENDENT) {
+        for (int s = 0; s < ctx->streams; s++)
+            lzw_decoder_reset(ctx->decoders[s]);
+    }
+
+    TRACE_SPAN_BEGIN(decode_start);
+    int status = lzw_decoder_decode_streams(ctx->decoders, ctx->streams, ins, in_lens, out, header->raw_size);
+    TRACE_SPAN_END(decode_start, "lzw_decode", header->raw_size);
+
+    return status;
+}
+
+int decompress_buffer(decompress_context *ctx, const unsigned char *in, size_t len, binaryio_writer *out) {
+    stream_header s_header;
+    if (len < STREAM_HEADER_SIZE)
+        return DECOMPRESS_ERR_TRUNCATED;
+    int header_status = decompress_read_header(&s_header, in);
+    if (header_status != 0)
+        return header_status;
+    decompress_context_reset(ctx, s_header.max_bits, s_header.streams, s_header.flags);
+
+    size_t offset = STREAM_HEADER_SIZE;
+    while (len - offset >= BLOCK_HEADER_SIZE) {
+        block_header b_header;
+        block_header_unpack(&b_header, in + offset);
+        offset += BLOCK_HEADER_SIZE;
+
+        if (b_header.type == BLOCK_END)
+            return 0;
+        if (b_header.raw_size > BLOCK_SIZE)
+            return DECOMPRESS_ERR_BLOCK;
+        if (b_header.payload_size > len - offset)
+            return DECOMPRESS_ERR_TRUNCATED;
+
+        binaryio_writer_reserve(out, b_header.raw_size);
+        int status = decompress_block(ctx, &b_header, in + offset, out->data + out->size);
+        if (status != 0)
+            return status;
+        out->size += b_header.raw_size;
+        offset += b_header.payload_size;
+    }
+
+    return DECOMPRESS_ERR_TRUNCATED; // the stream ended without an end block
+}
+
+void decompress_context_free(decompress_context *ctx) {
+    for (int s = 0; s < ctx->streams; s++)
+        lzw_decoder_free(ctx->decoders[s]);
+    free(ctx);
+}
+
+int decompress() {
+
+    unsigned char header_buf[BLOCK_HEADER_SIZE];
+
+    // We first get the max bits.
+    stream_header s_header;
+    if (fread(header_buf, 1, STREAM_HEADER_SIZE, stdin) < STREAM_HEADER_SIZE)
+        return DECOMPRESS_ERR_TRUNCATED;
+    int header_status = decompress_read_header(&s_header, header_buf);
+    if (header_status != 0)
+        return header_status;
+
+    decompress_context *ctx = decompress_context_new(s_header.max_bits, s_header.streams, s_header.flags);
+    arena *buffers = arena_new(arena_size(BLOCK_PAYLOAD_MAX) + arena_size(BLOCK_SIZE));
+    unsigned char *payload = arena_alloc(buffers, BLOCK_PAYLOAD_MAX);
+    unsigned char *block = arena_alloc(buffers, BLOCK_SIZE);
+    int status = DECOMPRESS_ERR_TRUNCATED; // unless we reach the end block
+
+    while (fread(header_buf, 1, BLOCK_HEADER_SIZE, stdin) == BLOCK_HEADER_SIZE) {
+        block_header b_header;
+        block_header_unpack(&b_header, header_buf);
+
+        if (b_header.type == BLOCK_END) {
+            status = 0;
+            break;
+        }
+        if (b_header.payload_size > BLOCK_PAYLOAD_MAX) {
+            status = DECOMPRESS_ERR_BLOCK;
+            break;
         }
 
-        old_code = next_code; 
+        TRACE_SPAN_BEGIN(read_start);
+        size_t got = fread(payload, 1, b_header.payload_size, stdin);
+        TRACE_SPAN_END(read_start, "read", got);
 
-        // In the event that we need to represent codes with more bits,
-        // we do so here.
-        if ((table->size + 1) >= cur_max && cur_bits < max_bits) {
-            cur_bits++;
-            cur_max *= 2; 
+        if (got < b_header.payload_size)
+            break;
+        int block_status = decompress_block(ctx, &b_header, payload, block);
+        if (block_status != 0) {
+            status = block_status;
+            break;
         }
 
+        TRACE_SPAN_BEGIN(write_start);
+        fwrite(block, 1, b_header.raw_size, stdout);
+        TRACE_SPAN_END(write_start, "write", b_header.raw_size);
     }
 
     if (getenv("DBG") != NULL && strcmp(getenv("DBG"), "1") == 0)
-        decompression_strtable_dump(table, "./DBG.decompress"); 
+        decompression_strtable_dump(ctx->decoders[0]->table, "./DBG.decompress"); 
     
-    decompression_strtable_free(table);
-    stack_free(char_stack);
+    arena_free(buffers);
+    decompress_context_free(ctx);
 
+    return status;
+}
+
+const char *decompress_error_string(int error) {
+    switch (error) {
+        case DECOMPRESS_ERR_HEADER: return "invalid stream header";
+        case DECOMPRESS_ERR_BLOCK: return "invalid block header";
+        case DECOMPRESS_ERR_CODE: return "invalid code";
+        case DECOMPRESS_ERR_OVERRUN: return "data past the end of a block";
+        case DECOMPRESS_ERR_TRUNCATED: return "truncated stream";
+        case DECOMPRESS_ERR_VERSION: return "unsupported format version";
+        case DECOMPRESS_ERR_FLAGS: return "unknown stream flags";
+        default: return "invalid stream";
+    }
 }
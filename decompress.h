@@ -1,10 +1,139 @@
 #ifndef DECOMPRESS
 #define DECOMPRESS
+#include <stddef.h>
+#include "string_table.h"
+#include "binaryIO.h"
+#include "pruner.h"
+#include "format.h"
+
+/*
+Why a stream was rejected. Every decoding function returns 0 on success or one of these,
+so callers can tell a damaged stream from a cut off one without decoding it again.
+Streams are untrusted input: every code is checked against the string table and every
+expansion against the room left in its block before anything is read or written.
+*/
+#define DECOMPRESS_ERR_HEADER -1 // the stream header is invalid or lacks the magic bytes
+#define DECOMPRESS_ERR_BLOCK -2 // a block header or a sub-stream size table is invalid
+#define DECOMPRESS_ERR_CODE -3 // a code that isn't in the string table
+#define DECOMPRESS_ERR_OVERRUN -4 // a code or run that expands past the end of its block
+#define DECOMPRESS_ERR_TRUNCATED -5 // the stream or a sub-stream ends early
+#define DECOMPRESS_ERR_VERSION -6 // the stream was written in a format version this build doesn't know
+#define DECOMPRESS_ERR_FLAGS -7 // the stream header sets flags this build doesn't know
+
+/*
+State of an LZW decoder, mirroring `lzw_encoder`: the string table is carried over
+from one block to the next.
+*/
+struct lzw_decoder {
+    decompression_strtable *table;
+    decompression_strtable *spare; // what table is pruned into, if the decoder prunes
+    int max_bits;
+    int prune;
+    int cur_bits; // width of the last code read, only tracked for tracing
+
+    pruner *pruner; // prunes in the background with STREAM_FLAG_ASYNC_PRUNE, otherwise NULL
+    size_t install_countdown; // codes left until a background prune is installed, 0 if none is running
+};
+
+typedef struct lzw_decoder lzw_decoder;
+
+/*
+Constructs a new decoder for a stream written with the given `max_bits` and STREAM_FLAG_* flags.
+The returned decoder is dynamically allocated and therefore must be freed.
+*/
+lzw_decoder *lzw_decoder_new(int max_bits, int flags);
+
+// Returns a decoder to the state it had right after construction, reusing its memory.
+void lzw_decoder_reset(lzw_decoder *decoder);
+
+/*
+Called after every code other than a run token, once the entry owed for the code before it
+has been added. Prunes the table if it is full, mirroring the encoder, or moves a background
+prune along. Returns 1 if the table will owe an entry for this code, or 0 if it won't because
+the table was just pruned or is frozen for a background prune.
+*/
+int lzw_decoder_update(lzw_decoder *decoder);
+
+/*
+Decodes one LZW block of `in_len` bytes into exactly `out_len` bytes at `out`.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the block is malformed.
+*/
+int lzw_decoder_decode(lzw_decoder *decoder, const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len);
+
+/*
+Decodes an LZW block of `out_len` bytes split into `streams` sub-streams, where sub-stream i
+is the `in_lens[i]` bytes at `ins[i]` and is decoded by `decoders[i]`. The sub-streams are
+decoded in lock-step on the calling thread so that their memory accesses overlap.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if any sub-stream is malformed.
+*/
+int lzw_decoder_decode_streams(lzw_decoder **decoders, int streams, const unsigned char **ins, const size_t *in_lens, unsigned char *out, size_t out_len);
+
+// Frees a decoder and its string table.
+void lzw_decoder_free(lzw_decoder *decoder);
+
+/*
+Everything needed to decompress a stream: one decoder per sub-stream.
+A context can be reset and reused for any number of streams.
+*/
+struct decompress_context {
+    int max_bits;
+    int streams;
+    int flags;
+
+    lzw_decoder *decoders[MAX_STREAMS];
+};
+
+typedef struct decompress_context decompress_context;
+
+/*
+Constructs a new decompression context for streams with the given STREAM_FLAG_* flags.
+The returned context is dynamically allocated and therefore must be freed.
+*/
+decompress_context *decompress_context_new(int max_bits, int streams, int flags);
+
+/*
+Prepares a context to decode a new stream with the given settings. String tables are
+reused when `max_bits` and `flags` are unchanged and only reallocated otherwise.
+*/
+void decompress_context_reset(decompress_context *ctx, int max_bits, int streams, int flags);
+
+/*
+Parses the STREAM_HEADER_SIZE bytes at buf into header.
+Returns 0 on success, DECOMPRESS_ERR_VERSION or DECOMPRESS_ERR_FLAGS if the header is from a
+format version or has flags this build doesn't know, or DECOMPRESS_ERR_HEADER if it is otherwise invalid.
+*/
+int decompress_read_header(stream_header *header, const unsigned char *buf);
+
+/*
+Locates the sub-streams within the payload of an LZW block, using the size table at its start:
+sub-stream i is the in_lens[i] bytes at ins[i].
+Returns 0 on success, or DECOMPRESS_ERR_BLOCK if the sizes don't fit in the payload.
+*/
+int decompress_split_streams(const unsigned char *payload, size_t payload_size, int streams, const unsigned char **ins, size_t *in_lens);
+
+/*
+Decodes one block, given its header and payload, into the `header->raw_size` bytes at out.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the block is malformed.
+*/
+int decompress_block(decompress_context *ctx, const block_header *header, const unsigned char *payload, unsigned char *out);
+
+/*
+Decompresses the complete stream of len bytes at in, appending the result to out.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the stream is malformed.
+*/
+int decompress_buffer(decompress_context *ctx, const unsigned char *in, size_t len, binaryio_writer *out);
+
+// Frees a context and everything it holds.
+void decompress_context_free(decompress_context *ctx);
 
 /*
 Decompresses a stream of bytes in stdin that was outputted from a call
 to `compress()` using the LZW algorithm. 
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the stream is malformed.
 */
-void decompress();
+int decompress();
+
+// Describes a DECOMPRESS_ERR_* code.
+const char *decompress_error_string(int error);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,54 @@
+#include "format.h"
+
+void pack_u32(uint32_t value, unsigned char *buf) {
+    buf[0] = (value >> 24) & 0xff;
+    buf[1] = (value >> 16) & 0xff;
+    buf[2] = (value >> 8) & 0xff;
+    buf[3] = value & 0xff;
+}
+
+uint32_t unpack_u32(const unsigned char *buf) {
+    return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+void stream_header_pack(const stream_header *header, unsigned char *buf) {
+    buf[0] = STREAM_MAGIC_0;
+    buf[1] = STREAM_MAGIC_1;
+    buf[2] = STREAM_VERSION;
+    buf[3] = header->max_bits;
+    buf[4] = header->flags;
+    buf[5] = header->streams;
+}
+
+void stream_header_unpack(stream_header *header, const unsigned char *buf) {
+    header->magic = (buf[0] << 8) | buf[1];
+    header->version = buf[2];
+    header->max_bits = buf[3];
+    header->flags = buf[4];
+    header->streams = buf[5];
+}
+
+void block_header_pack(const block_header *header, unsigned char *buf) {
+    buf[0] = header->type;
+    pack_u32(header->raw_size, buf + 1);
+    pack_u32(header->payload_size, buf + 5);
+}
+
+void block_header_unpack(block_header *header, const unsigned char *buf) {
+    header->type = buf[0];
+    header->raw_size = unpack_u32(buf + 1);
+    header->payload_size = unpack_u32(buf + 5);
+}
+
+int lzw_code_bits(size_t table_size, int max_bits) {
+    // bit length of the largest code in the table
+    int bits = (table_size > 1) ? 64 - __builtin_clzll((unsigned long long) table_size - 1) : 0;
+
+    if (bits < MIN_CODE_BITS)
+        return MIN_CODE_BITS;
+    return (bits > max_bits) ? max_bits : bits;
+}
+
+size_t block_stream_offset(size_t raw_size, int streams, int index) {
+    return (raw_size * index) / streams;
+}
@@ -0,0 +1,120 @@
+/*
+Definitions for the on-disk format shared by compress and decompress.
+
+A compressed file starts with a stream header followed by a sequence of blocks.
+Each block covers at most BLOCK_SIZE bytes of the original input and is either
+LZW coded or stored verbatim, and the sequence is terminated by a BLOCK_END header.
+Inside an LZW block, long runs of a single byte are written as run tokens.
+The string tables persist across LZW blocks, so a stored block in the middle of a file
+doesn't cost the dictionary built up by the blocks before it, unless the stream has
+STREAM_FLAG_INDEPENDENT set.
+*/
+#ifndef FORMAT
+#define FORMAT
+#include <stdint.h>
+#include <stddef.h>
+
+#define ASCII_CHAR_MAX 256
+#define MIN_CODE_BITS 9
+#define MAX_BITS_UB 20 // Maximum value for max_bits.
+#define MAX_BITS_LB 9 // Minimum value for max_bits.
+
+#define BLOCK_SIZE (1 << 16) // Uncompressed bytes per block.
+
+/*
+Code 256 is reserved as a run token: it is followed by the repeated byte (8 bits) and
+the run length minus RUN_MIN_LENGTH (RUN_LENGTH_BITS bits). Both string tables hold a
+placeholder entry at 256 so that dictionary codes start at 257 on both sides.
+*/
+#define RUN_CODE ASCII_CHAR_MAX
+#define RUN_MIN_LENGTH 32
+#define RUN_LENGTH_BITS 16
+#define RUN_MAX_LENGTH (RUN_MIN_LENGTH + (1 << RUN_LENGTH_BITS) - 1)
+
+#define MAX_STREAMS 8
+
+// Upper bound on the payload of any block, even one that LZW coding expanded.
+#define BLOCK_PAYLOAD_MAX (4 * BLOCK_SIZE)
+
+/*
+The stream header starts with the magic bytes "LZ" and the format version, so input that wasn't
+written by compress, or was written by a later version with a different layout, is rejected up front.
+*/
+#define STREAM_MAGIC_0 'L'
+#define STREAM_MAGIC_1 'Z'
+#define STREAM_VERSION 1
+
+#define STREAM_HEADER_SIZE 6
+#define BLOCK_HEADER_SIZE 9
+
+/*
+Stream flags. With STREAM_FLAG_ASYNC_PRUNE, a full string table is pruned in the background:
+both sides keep coding with the full table, which takes no new entries, and switch to the pruned
+table after exactly (2^max_bits >> PRUNE_INSTALL_SHIFT) more codes, not counting run tokens.
+*/
+#define STREAM_FLAG_ASYNC_PRUNE 0x01
+
+/*
+With STREAM_FLAG_INDEPENDENT, every LZW block starts from fresh string tables, so a block's
+payload depends only on its own bytes and the stream settings and can be decoded on its own.
+*/
+#define STREAM_FLAG_INDEPENDENT 0x02
+#define STREAM_FLAGS_KNOWN (STREAM_FLAG_ASYNC_PRUNE | STREAM_FLAG_INDEPENDENT)
+#define PRUNE_INSTALL_SHIFT 4
+
+// Block types.
+#define BLOCK_END 0
+#define BLOCK_LZW 1
+#define BLOCK_STORED 2
+
+struct stream_header {
+    int magic; // both magic bytes, STREAM_MAGIC_0 in the high byte
+    int version;
+    int max_bits;
+    int flags; // STREAM_FLAG_* bits
+    int streams; // number of sub-streams per LZW block
+};
+
+typedef struct stream_header stream_header;
+
+struct block_header {
+    int type;
+    uint32_t raw_size;     // bytes of original data the block decodes to
+    uint32_t payload_size; // bytes of block data following the header
+};
+
+typedef struct block_header block_header;
+
+// Writes a 32 bit integer at buf in big-endian byte order.
+void pack_u32(uint32_t value, unsigned char *buf);
+
+// Reads a big-endian 32 bit integer from buf.
+uint32_t unpack_u32(const unsigned char *buf);
+
+// Serializes a stream header into STREAM_HEADER_SIZE bytes at buf, with the magic bytes and STREAM_VERSION.
+void stream_header_pack(const stream_header *header, unsigned char *buf);
+
+// Parses STREAM_HEADER_SIZE bytes at buf into a stream header.
+void stream_header_unpack(stream_header *header, const unsigned char *buf);
+
+// Serializes a block header into BLOCK_HEADER_SIZE bytes at buf. Sizes are stored big-endian.
+void block_header_pack(const block_header *header, unsigned char *buf);
+
+// Parses BLOCK_HEADER_SIZE bytes at buf into a block header.
+void block_header_unpack(block_header *header, const unsigned char *buf);
+
+/*
+Returns the number of bits used to write the next code, given how many codes
+the encoder's string table holds when the code is written. Every code written is
+smaller than table_size, so this is the smallest width that fits table_size - 1,
+clamped to [MIN_CODE_BITS, max_bits].
+*/
+int lzw_code_bits(size_t table_size, int max_bits);
+
+/*
+Returns the offset of the first byte of sub-stream `index` in a block of `raw_size` bytes
+split into `streams` sub-streams. An index of `streams` returns raw_size.
+*/
+size_t block_stream_offset(size_t raw_size, int streams, int index);
+
+#endif
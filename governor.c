@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "governor.h"
+
+/*Reads a clock in seconds.*/
+double __governor_clock(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+governor *governor_new(double max_rate, double cpu_share) {
+    governor *g = calloc(1, sizeof(governor));
+    g->max_rate = max_rate;
+    g->cpu_share = cpu_share;
+    g->start_wall = __governor_clock(CLOCK_MONOTONIC);
+    g->start_cpu = __governor_clock(CLOCK_PROCESS_CPUTIME_ID);
+    return g;
+}
+
+void governor_pace(governor *g, size_t bytes) {
+    g->bytes += bytes;
+
+    double elapsed = __governor_clock(CLOCK_MONOTONIC) - g->start_wall;
+    double due = elapsed; // when the work done so far is allowed to be finished
+
+    if (g->max_rate > 0 && g->bytes / g->max_rate > due)
+        due = g->bytes / g->max_rate;
+
+    // the CPU time of every thread counts, so a verifier's share is included
+    if (g->cpu_share > 0) {
+        double cpu = __governor_clock(CLOCK_PROCESS_CPUTIME_ID) - g->start_cpu;
+        if (cpu / g->cpu_share > due)
+            due = cpu / g->cpu_share;
+    }
+
+    double wait = due - elapsed;
+    if (wait <= 0)
+        return;
+
+    struct timespec ts = {.tv_sec = (time_t) wait, .tv_nsec = (long) ((wait - (time_t) wait) * 1e9)};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+
+    g->throttled += __governor_clock(CLOCK_MONOTONIC) - g->start_wall - elapsed;
+    g->pauses++;
+}
+
+void governor_report(governor *g, const char *name, FILE *f) {
+    double elapsed = __governor_clock(CLOCK_MONOTONIC) - g->start_wall;
+    double cpu = __governor_clock(CLOCK_PROCESS_CPUTIME_ID) - g->start_cpu;
+    if (elapsed <= 0)
+        elapsed = 1e-9;
+
+    fprintf(f, "%s: %.2f MiB in %.2f s (%.2f MiB/s, %.0f%% CPU), throttled for %.2f s (%.0f%%) in %llu pauses\n",
+        name, g->bytes / 1048576.0, elapsed, g->bytes / 1048576.0 / elapsed, 100 * cpu / elapsed,
+        g->throttled, 100 * g->throttled / elapsed, (unsigned long long) g->pauses);
+}
+
+void governor_free(governor *g) {
+    free(g);
+}
@@ -0,0 +1,47 @@
+/*
+Cooperative throttling for long-running compressions that share a host with
+latency-sensitive services.
+
+The codec calls `governor_pace` at every block boundary. If it is ahead of either
+limit, the governor sleeps until it no longer is, so the limits hold on average over
+the run while individual blocks still go at full speed.
+*/
+#ifndef GOVERNOR
+#define GOVERNOR
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct governor {
+    double max_rate; // bytes per second, or 0 for no limit
+    double cpu_share; // fraction of one CPU the process may use, or 0 for no limit
+
+    double start_wall; // seconds
+    double start_cpu; // seconds of CPU time used by the whole process
+    uint64_t bytes; // input bytes processed so far
+
+    double throttled; // seconds spent sleeping
+    uint64_t pauses;
+};
+
+typedef struct governor governor;
+
+/*
+Constructs a governor with the given limits and starts its clock.
+The returned governor is dynamically allocated and therefore must be freed.
+*/
+governor *governor_new(double max_rate, double cpu_share);
+
+/*
+Accounts for `bytes` more input bytes, then sleeps for as long as the process is
+ahead of its throughput limit or over its CPU share.
+*/
+void governor_pace(governor *g, size_t bytes);
+
+// Writes a one line summary of the throughput, CPU use and throttling so far to f.
+void governor_report(governor *g, const char *name, FILE *f);
+
+// Frees a governor.
+void governor_free(governor *g);
+
+#endif
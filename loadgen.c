@@ -0,0 +1,295 @@
+#define _GNU_SOURCE // for pipe2
+#include "loadgen.h"
+#include "compress.h"
+#include "server.h"
+#include "format.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Number of distinct payloads cut from the input file.
+#define LOADGEN_PAYLOADS 64
+
+/*Shared, read-only description of the test plus the latency of every request.*/
+struct loadgen_state {
+    const loadgen_options *options;
+
+    unsigned char *payloads[LOADGEN_PAYLOADS];
+    size_t payload_sizes[LOADGEN_PAYLOADS];
+
+    double *latencies; // in microseconds, one slot per request
+    int failures;
+    pthread_mutex_t lock;
+};
+
+typedef struct loadgen_state loadgen_state;
+
+struct loadgen_client {
+    pthread_t thread;
+    loadgen_state *state;
+    int first; // index of the first request this client sends
+    int count;
+};
+
+typedef struct loadgen_client loadgen_client;
+
+double __now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int __compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*Sends one request over a connection to the service and reads the response into out. Compress
+requests carry the settings from options. Returns 0 if the service answered with success.*/
+int __service_request(int fd, const loadgen_options *options, const unsigned char *payload, size_t len, binaryio_writer *out) {
+    unsigned char frame[SERVER_FRAME_HEADER_SIZE];
+    unsigned char settings[SERVER_SETTINGS_SIZE] = {options->max_bits, options->streams};
+    size_t settings_size = options->decompress ? 0 : SERVER_SETTINGS_SIZE;
+    frame[0] = options->decompress ? SERVER_OP_DECOMPRESS : SERVER_OP_COMPRESS_SETTINGS;
+    pack_u32(settings_size + len, frame + 1);
+
+    if (server_write_full(fd, frame, SERVER_FRAME_HEADER_SIZE) != 0
+        || server_write_full(fd, settings, settings_size) != 0
+        || server_write_full(fd, payload, len) != 0
+        || server_read_full(fd, frame, SERVER_FRAME_HEADER_SIZE) != 1)
+        return -1;
+
+    size_t response_len = unpack_u32(frame + 1);
+    binaryio_writer_reset(out);
+    binaryio_writer_reserve(out, response_len);
+    if (server_read_full(fd, out->data, response_len) != 1)
+        return -1;
+    out->size = response_len;
+
+    return (frame[0] == SERVER_STATUS_OK) ? 0 : -1;
+}
+
+/*Runs one request through a new process of this program, `compress` with the settings from
+options or `decompress`, feeding it the payload on stdin and collecting its stdout. Returns 0
+if the process succeeded.*/
+int __process_request(const loadgen_options *options, const unsigned char *payload, size_t len, binaryio_writer *out) {
+    // we format the arguments before forking, since the child may only call async-signal-safe functions
+    char max_bits[16], streams[16];
+    snprintf(max_bits, sizeof(max_bits), "%d", options->max_bits);
+    snprintf(streams, sizeof(streams), "%d", options->streams);
+
+    // close-on-exec keeps children started by other threads from holding our pipes open
+    int to_child[2], from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0 || pipe2(from_child, O_CLOEXEC) != 0)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        close(to_child[0]); close(to_child[1]);
+        close(from_child[0]); close(from_child[1]);
+        if (options->decompress)
+            execl("/proc/self/exe", "decompress", (char *) NULL);
+        else
+            execl("/proc/self/exe", "compress", "-m", max_bits, "-n", streams, (char *) NULL);
+        _exit(127);
+    }
+    close(to_child[0]);
+    close(from_child[1]);
+
+    // we write the payload and read the output at the same time so neither pipe can fill up
+    binaryio_writer_reset(out);
+    size_t written = 0;
+    int in_fd = to_child[1], out_fd = from_child[0];
+    if (len == 0) {
+        close(in_fd);
+        in_fd = -1;
+    }
+
+    while (out_fd >= 0) {
+        struct pollfd fds[2] = {{.fd = out_fd, .events = POLLIN}, {.fd = in_fd, .events = POLLOUT}};
+        if (poll(fds, (in_fd >= 0) ? 2 : 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (in_fd >= 0 && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            ssize_t n = write(in_fd, payload + written, len - written);
+            if (n > 0)
+                written += n;
+            if (n < 0 || written == len) {
+                close(in_fd);
+                in_fd = -1;
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            binaryio_writer_reserve(out, 65536);
+            ssize_t n = read(out_fd, out->data + out->size, 65536);
+            if (n <= 0) {
+                close(out_fd);
+                out_fd = -1;
+            }
+            else {
+                out->size += n;
+            }
+        }
+    }
+    if (in_fd >= 0)
+        close(in_fd);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+void *__loadgen_client_main(void *arg) {
+    loadgen_client *client = arg;
+    loadgen_state *state = client->state;
+    const loadgen_options *options = state->options;
+    binaryio_writer *response = binaryio_writer_new();
+    int failures = 0;
+    int fd = -1;
+
+    if (!options->fork_mode) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        strncpy(addr.sun_path, options->socket_path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+            perror("compressload: connect");
+            failures = client->count;
+            client->count = 0;
+        }
+    }
+
+    for (int i = client->first; i < client->first + client->count; i++) {
+        int p = i % LOADGEN_PAYLOADS;
+        double start = __now_us();
+
+        int result;
+        if (options->fork_mode)
+            result = __process_request(options, state->payloads[p], state->payload_sizes[p], response);
+        else
+            result = __service_request(fd, options, state->payloads[p], state->payload_sizes[p], response);
+
+        state->latencies[i] = __now_us() - start;
+        if (result != 0)
+            failures++;
+    }
+
+    if (fd >= 0)
+        close(fd);
+    binaryio_writer_free(response);
+
+    pthread_mutex_lock(&state->lock);
+    state->failures += failures;
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+/*Cuts LOADGEN_PAYLOADS payloads of request_size bytes from evenly spaced offsets of the input file.
+For decompress tests the payloads are compressed up front with the settings from options.*/
+int __loadgen_prepare(loadgen_state *state) {
+    const loadgen_options *options = state->options;
+    FILE *file = fopen(options->input_path, "rb");
+    if (file == NULL) {
+        perror("compressload");
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t file_size = ftell(file);
+    size_t size = (options->request_size < file_size) ? options->request_size : file_size;
+
+    compress_context *ctx = compress_context_new(options->max_bits, options->streams, 0);
+    binaryio_writer *compressed = binaryio_writer_new();
+
+    for (int p = 0; p < LOADGEN_PAYLOADS; p++) {
+        size_t offset = (file_size > size) ? ((file_size - size) / LOADGEN_PAYLOADS) * p : 0;
+        unsigned char *payload = malloc(size ? size : 1);
+        fseek(file, offset, SEEK_SET);
+        size_t got = fread(payload, 1, size, file);
+
+        if (options->decompress) {
+            compress_context_reset(ctx);
+            binaryio_writer_reset(compressed);
+            compress_buffer(ctx, payload, got, compressed);
+            payload = realloc(payload, compressed->size);
+            memcpy(payload, compressed->data, compressed->size);
+            got = compressed->size;
+        }
+
+        state->payloads[p] = payload;
+        state->payload_sizes[p] = got;
+    }
+
+    binaryio_writer_free(compressed);
+    compress_context_free(ctx);
+    fclose(file);
+    return 0;
+}
+
+int loadgen_run(const loadgen_options *options) {
+    loadgen_state state = {.options = options, .failures = 0};
+    pthread_mutex_init(&state.lock, NULL);
+
+    if (__loadgen_prepare(&state) != 0)
+        return -1;
+    state.latencies = calloc(options->requests, sizeof(double));
+
+    // each connection is a closed loop sending its share of the requests back to back
+    loadgen_client *clients = calloc(options->connections, sizeof(loadgen_client));
+    int first = 0;
+    double start = __now_us();
+    for (int c = 0; c < options->connections; c++) {
+        clients[c].state = &state;
+        clients[c].first = first;
+        clients[c].count = options->requests / options->connections + (c < options->requests % options->connections);
+        first += clients[c].count;
+        int error = pthread_create(&clients[c].thread, NULL, __loadgen_client_main, &clients[c]);
+        if (error != 0) {
+            // the clients that did start are cut short by the exit that follows
+            fprintf(stderr, "compressload: pthread_create: %s\n", strerror(error));
+            return -1;
+        }
+    }
+    for (int c = 0; c < options->connections; c++)
+        pthread_join(clients[c].thread, NULL);
+    double elapsed = (__now_us() - start) / 1e6;
+
+    size_t bytes = 0;
+    for (int i = 0; i < options->requests; i++)
+        bytes += state.payload_sizes[i % LOADGEN_PAYLOADS];
+
+    qsort(state.latencies, options->requests, sizeof(double), __compare_doubles);
+    int p50 = (options->requests - 1) * 50 / 100;
+    int p99 = (options->requests - 1) * 99 / 100;
+
+    printf("mode: %s %s, %d requests of %zu bytes over %d connections, MAXBITS=%d STREAMS=%d\n",
+        options->fork_mode ? "fork-per-request" : "service",
+        options->decompress ? "decompress" : "compress",
+        options->requests, state.payload_sizes[0], options->connections, options->max_bits, options->streams);
+    printf("throughput: %.1f requests/s (%.2f MB/s)\n", options->requests / elapsed, bytes / elapsed / 1e6);
+    printf("latency: p50 %.1f us, p99 %.1f us\n", state.latencies[p50], state.latencies[p99]);
+    if (state.failures)
+        printf("failed requests: %d\n", state.failures);
+
+    for (int p = 0; p < LOADGEN_PAYLOADS; p++)
+        free(state.payloads[p]);
+    free(state.latencies);
+    free(clients);
+    pthread_mutex_destroy(&state.lock);
+
+    return state.failures ? -1 : 0;
+}
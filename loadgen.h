@@ -0,0 +1,31 @@
+/*
+Load generator for the compression service. Sends a fixed number of requests over several
+concurrent connections and reports throughput and latency percentiles. For comparison it can
+instead run every request through a freshly started `compress`/`decompress` process. Both modes
+compress with the same MAXBITS and STREAMS, which are sent to the service with every request.
+*/
+#ifndef LOADGEN
+#define LOADGEN
+#include <stddef.h>
+
+struct loadgen_options {
+    const char *socket_path; // service to send requests to, unused when fork_mode is set
+    const char *input_path; // file the request payloads are cut from
+    int connections;
+    int requests;
+    size_t request_size;
+    int decompress; // send decompress requests instead of compress requests
+    int fork_mode; // start one process per request instead of using the service
+    int max_bits; // settings compress requests are coded with in both modes
+    int streams;
+};
+
+typedef struct loadgen_options loadgen_options;
+
+/*
+Runs the load test described by options and prints a summary to stdout.
+Returns 0 if every request succeeded and -1 otherwise.
+*/
+int loadgen_run(const loadgen_options *options);
+
+#endif
@@ -3,14 +3,19 @@
 #include <stdlib.h>
 #include <libgen.h> // Include for basename
 #include <unistd.h> // for argument parsing
+#include <getopt.h> // for long options
 #include <limits.h>
 
 #include "compress.h"
 #include "decompress.h"
 #include "string_table.h"
-#define MAX_BITS_UB 20 // Maximum value for max_bits.
-#define MAX_BITS_LB 9 // Minimum value for max_bits.
+#include "format.h"
+#include "server.h"
+#include "loadgen.h"
+#include "search.h"
+#include "trace.h"
 #define MAX_BITS_DEFAULT 12
+#define WORKERS_DEFAULT 4
 
 int main(int argc, char *argv[])
 {
@@ -19,42 +24,250 @@ int main(int argc, char *argv[])
     setvbuf(stdout, bout, _IOFBF, 64);
 
     char *exec_name = basename(argv[0]); // Get the executable name
+    TRACE_INIT(exec_name);
 
     if (strcmp(exec_name, "compress") == 0) {
-        int max_bits = MAX_BITS_DEFAULT;
+        compress_options options = {.max_bits = MAX_BITS_DEFAULT, .streams = 1, .verify = 0,
+            .max_rate = 0, .cpu_share = 0, .max_memory = 0, .async_prune = 0,
+            .independent = 0, .cache_dir = NULL, .cache_size = (size_t) 1024 * 1048576};
         
         int c;
         int arg;
+        double limit;
+
+        // the resource limits, the cache and the stream flags only have long names
+        static struct option long_options[] = {
+            {"verify", no_argument, NULL, 'v'},
+            {"max-rate", required_argument, NULL, 'R'},
+            {"cpu-share", required_argument, NULL, 'C'},
+            {"max-memory", required_argument, NULL, 'M'},
+            {"async-prune", no_argument, NULL, 'A'},
+            {"independent", no_argument, NULL, 'I'},
+            {"cache", required_argument, NULL, 'D'},
+            {"cache-size", required_argument, NULL, 'S'},
+            {NULL, 0, NULL, 0}
+        };
 
         // Using getopt to parse command line options
         // m: indicates m takes an argument
-        while ((c = getopt(argc, argv, "m:p")) != -1) {
+        while ((c = getopt_long(argc, argv, "m:n:pv", long_options, NULL)) != -1) {
             switch (c) {
                 case 'm':
                     arg = atoi(optarg);
                     if (MAX_BITS_LB <= arg && arg <= MAX_BITS_UB) {
-                        max_bits = arg;
+                        options.max_bits = arg;
                     }
                     else {
                         fprintf(stderr, "compress: MAXBITS must be between 9 and 20. Running with MAXBITS=12\n");
                     }
                     break;
+                case 'n':
+                    arg = atoi(optarg);
+                    if (1 <= arg && arg <= MAX_STREAMS) {
+                        options.streams = arg;
+                    }
+                    else {
+                        fprintf(stderr, "compress: STREAMS must be between 1 and %d. Running with STREAMS=1\n", MAX_STREAMS);
+                    }
+                    break;
+                case 'v':
+                    options.verify = 1;
+                    break;
+                case 'A':
+                    options.async_prune = 1;
+                    break;
+                case 'I':
+                    options.independent = 1;
+                    break;
+                case 'D':
+                    options.cache_dir = optarg;
+                    break;
+                case 'S':
+                    limit = atof(optarg);
+                    if (limit > 0) {
+                        options.cache_size = limit * 1048576;
+                    }
+                    else {
+                        fprintf(stderr, "compress: --cache-size must be a positive number of MiB\n");
+                        exit(1);
+                    }
+                    break;
+                case 'R':
+                    limit = atof(optarg);
+                    if (limit > 0) {
+                        options.max_rate = limit * 1048576;
+                    }
+                    else {
+                        fprintf(stderr, "compress: --max-rate must be a positive number of MiB/s\n");
+                        exit(1);
+                    }
+                    break;
+                case 'C':
+                    limit = atof(optarg);
+                    if (0 < limit && limit <= 1) {
+                        options.cpu_share = limit;
+                    }
+                    else {
+                        fprintf(stderr, "compress: --cpu-share must be more than 0 and at most 1\n");
+                        exit(1);
+                    }
+                    break;
+                case 'M':
+                    limit = atof(optarg);
+                    if (limit > 0) {
+                        options.max_memory = limit * 1048576;
+                    }
+                    else {
+                        fprintf(stderr, "compress: --max-memory must be a positive number of MiB\n");
+                        exit(1);
+                    }
+                    break;
                 case '?':
                     fprintf(stderr, "compress: unknown option or missing argument\n");
                     exit(1); 
             }
         }
 
-        compress(max_bits);
+        if (compress(&options) != 0)
+            exit(1);
     } else if (strcmp(exec_name, "decompress") == 0) {
-        if (argc > 1) {
-            fprintf(stderr, "decompress: invalid option '%s'\n", argv[1]);
+        char *pattern = NULL;
+        int c;
+
+        static struct option long_options[] = {
+            {"grep", required_argument, NULL, 'g'},
+            {NULL, 0, NULL, 0}
+        };
+
+        while ((c = getopt_long(argc, argv, "g:", long_options, NULL)) != -1) {
+            switch (c) {
+                case 'g':
+                    pattern = optarg;
+                    break;
+                case '?':
+                    fprintf(stderr, "decompress: unknown option or missing argument\n");
+                    exit(1);
+            }
+        }
+        if (optind != argc) {
+            fprintf(stderr, "decompress: invalid option '%s'\n", argv[optind]);
+            exit(1);
+        }
+
+        /*Like grep, we exit with 0 if the pattern was found, 1 if it wasn't and 2 if
+        the stream was malformed.*/
+        if (pattern != NULL) {
+            int len = strlen(pattern);
+            if (len < 1 || len > SEARCH_PATTERN_MAX) {
+                fprintf(stderr, "decompress: PATTERN must be between 1 and %d bytes long\n", SEARCH_PATTERN_MAX);
+                exit(2);
+            }
+
+            uint64_t matches;
+            int status = search((unsigned char *) pattern, len, &matches);
+            if (status != 0) {
+                fflush(stdout);
+                fprintf(stderr, "decompress: input is not a valid compressed stream (%s)\n", decompress_error_string(status));
+                exit(2);
+            }
+            exit(matches > 0 ? 0 : 1);
+        }
+
+        int status = decompress();
+        if (status != 0) {
+            fflush(stdout);
+            fprintf(stderr, "decompress: input is not a valid compressed stream (%s)\n", decompress_error_string(status));
+            exit(1);
+        }
+    } else if (strcmp(exec_name, "compressd") == 0) {
+        int max_bits = MAX_BITS_DEFAULT;
+        int streams = 1;
+        int workers = WORKERS_DEFAULT;
+        int c;
+
+        while ((c = getopt(argc, argv, "m:n:w:")) != -1) {
+            switch (c) {
+                case 'm':
+                    max_bits = atoi(optarg);
+                    break;
+                case 'n':
+                    streams = atoi(optarg);
+                    break;
+                case 'w':
+                    workers = atoi(optarg);
+                    break;
+                case '?':
+                    fprintf(stderr, "compressd: unknown option or missing argument\n");
+                    exit(1);
+            }
+        }
+        if (max_bits < MAX_BITS_LB || max_bits > MAX_BITS_UB || streams < 1 || streams > MAX_STREAMS
+            || workers < 1 || optind != argc - 1) {
+            fprintf(stderr, "Usage: %s [-m MAXBITS] [-n STREAMS] [-w WORKERS] SOCKET\n", argv[0]);
             exit(1);
         }
-        decompress();
+
+        server_run(argv[optind], workers, max_bits, streams);
+        exit(1);
+    } else if (strcmp(exec_name, "compressload") == 0) {
+        loadgen_options options = {
+            .socket_path = NULL,
+            .connections = 1,
+            .requests = 1000,
+            .request_size = 4096,
+            .decompress = 0,
+            .fork_mode = 0,
+            .max_bits = MAX_BITS_DEFAULT,
+            .streams = 1
+        };
+        int c;
+
+        while ((c = getopt(argc, argv, "S:c:r:s:dfm:n:")) != -1) {
+            switch (c) {
+                case 'S':
+                    options.socket_path = optarg;
+                    break;
+                case 'c':
+                    options.connections = atoi(optarg);
+                    break;
+                case 'r':
+                    options.requests = atoi(optarg);
+                    break;
+                case 's':
+                    options.request_size = strtoul(optarg, NULL, 10);
+                    break;
+                case 'd':
+                    options.decompress = 1;
+                    break;
+                case 'f':
+                    options.fork_mode = 1;
+                    break;
+                case 'm':
+                    options.max_bits = atoi(optarg);
+                    break;
+                case 'n':
+                    options.streams = atoi(optarg);
+                    break;
+                case '?':
+                    fprintf(stderr, "compressload: unknown option or missing argument\n");
+                    exit(1);
+            }
+        }
+        if ((options.socket_path == NULL && !options.fork_mode) || options.connections < 1
+            || options.requests < 1 || options.max_bits < MAX_BITS_LB || options.max_bits > MAX_BITS_UB
+            || options.streams < 1 || options.streams > MAX_STREAMS || optind != argc - 1) {
+            fprintf(stderr, "Usage: %s [-m MAXBITS] [-n STREAMS] [-c CONNECTIONS] [-r REQUESTS] [-s SIZE] [-d] (-S SOCKET | -f) FILE\n", argv[0]);
+            exit(1);
+        }
+        options.input_path = argv[optind];
+
+        if (loadgen_run(&options) != 0)
+            exit(1);
     } else {
-        fprintf(stderr, "Usage: %s [-m MAXBITS] < input > output\n", argv[0]);
-        fprintf(stderr, "       %s < input > output\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-m MAXBITS] [-n STREAMS] [--verify] [--async-prune] [--independent] [--cache DIR [--cache-size MIB]] [--max-rate MIBPS] [--cpu-share FRACTION] [--max-memory MIB] < input > output\n", argv[0]);
+        fprintf(stderr, "       %s [--grep PATTERN] < input > output\n", argv[0]);
+        fprintf(stderr, "       %s [-m MAXBITS] [-n STREAMS] [-w WORKERS] SOCKET\n", argv[0]);
+        fprintf(stderr, "       %s [-m MAXBITS] [-n STREAMS] [-c CONNECTIONS] [-r REQUESTS] [-s SIZE] [-d] (-S SOCKET | -f) FILE\n", argv[0]);
         exit(1);
     }
 
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include "pruner.h"
+#include "trace.h"
+
+/*Body of the pruner thread: runs every prune it is handed until it is told to stop.*/
+void *__pruner_main(void *arg) {
+    pruner *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (!p->requested && !p->stop)
+            pthread_cond_wait(&p->changed, &p->lock);
+        if (p->stop)
+            break;
+        p->requested = 0;
+        pthread_mutex_unlock(&p->lock);
+
+        TRACE_SPAN_BEGIN(prune_start);
+        p->prune(p->original, p->pruned);
+        TRACE_SPAN_END(prune_start, "background_prune", 0);
+
+        pthread_mutex_lock(&p->lock);
+        p->done = 1;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+pruner *pruner_new(void (*prune)(void *original, void *pruned)) {
+    pruner *p = calloc(1, sizeof(pruner));
+    p->prune = prune;
+    p->done = 1; // nothing to wait for yet
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+    pthread_create(&p->thread, NULL, __pruner_main, p);
+
+    return p;
+}
+
+void pruner_start(pruner *p, void *original, void *pruned) {
+    pthread_mutex_lock(&p->lock);
+    p->original = original;
+    p->pruned = pruned;
+    p->requested = 1;
+    p->done = 0;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pruner_wait(pruner *p) {
+    pthread_mutex_lock(&p->lock);
+    while (!p->done)
+        pthread_cond_wait(&p->changed, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pruner_free(pruner *p) {
+    pruner_wait(p);
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+
+    pthread_join(p->thread, NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->changed);
+    free(p);
+}
@@ -0,0 +1,48 @@
+/*
+A helper thread that prunes string tables in the background.
+
+With asynchronous pruning, a table that fills up is handed to the pruner instead of being
+pruned on the spot. A full table takes no more entries, so the codec can keep coding with
+it while the pruner reads it, and swaps in the pruned table once it has been built. The
+thread is started along with its codec and sleeps between prunes, so pruning never
+creates threads or allocates.
+*/
+#ifndef PRUNER
+#define PRUNER
+#include <pthread.h>
+
+struct pruner {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    void (*prune)(void *original, void *pruned); // prunes original into pruned
+    void *original;
+    void *pruned;
+
+    int requested; // a prune is waiting to be picked up
+    int done; // the last prune requested has finished
+    int stop;
+};
+
+typedef struct pruner pruner;
+
+/*
+Starts a pruner thread that prunes tables with the given function.
+The returned pruner is dynamically allocated and must be freed with pruner_free.
+*/
+pruner *pruner_new(void (*prune)(void *original, void *pruned));
+
+/*
+Starts pruning original into pruned on the pruner's thread. original must not change and
+neither table may be touched by anyone else until pruner_wait returns; original may be read.
+*/
+void pruner_start(pruner *p, void *original, void *pruned);
+
+// Waits until the last prune started has finished. Returns at once if there is none.
+void pruner_wait(pruner *p);
+
+// Waits for any prune in progress, then stops the thread and frees the pruner.
+void pruner_free(pruner *p);
+
+#endif
@@ -0,0 +1,354 @@
+#include <inttypes.h>
+#include "search.h"
+#include "decompress.h"
+#include "string_table.h"
+#include "stack.h"
+#include "binaryIO.h"
+#include "format.h"
+
+search_pattern *search_pattern_new(const unsigned char *bytes, int len) {
+    search_pattern *pattern = malloc(sizeof(search_pattern));
+    pattern->len = len;
+    pattern->bytes = malloc(len);
+    memcpy(pattern->bytes, bytes, len);
+    pattern->delta = calloc((size_t) (len + 1) * 256, sizeof(unsigned short));
+
+    unsigned short *delta = pattern->delta;
+    delta[bytes[0]] = 1;
+
+    // x is the state reached by the pattern without its first byte, which is where
+    // a mismatch in state j leaves us
+    int x = 0;
+    for (int j = 1; j <= len; j++) {
+        memcpy(delta + j * 256, delta + x * 256, 256 * sizeof(unsigned short));
+        if (j < len) {
+            delta[j * 256 + bytes[j]] = j + 1;
+            x = delta[x * 256 + bytes[j]];
+        }
+    }
+
+    return pattern;
+}
+
+void search_pattern_free(search_pattern *pattern) {
+    free(pattern->delta);
+    free(pattern->bytes);
+    free(pattern);
+}
+
+/*Computes the search metadata of a code from its table entry and its prefix's metadata.*/
+void __search_table_add(search_table *t, const search_pattern *pattern, decompression_strtable *table, int code) {
+    strtable_entry *data = &(table->arr[code]);
+    search_entry *e = &(t->arr[code]);
+
+    // the table is filled in code order, so this is when it outgrows a huge page
+    if ((size_t) code == ARENA_HUGE_PAGE_SIZE / sizeof(search_entry))
+        arena_use_huge_pages(t->arena);
+
+    if (data->prefix == -1) {
+        // the run token's placeholder never stands for a string of its own
+        if (data->character == RUN_CODE) {
+            *e = (search_entry) {.length = 0, .head = code, .last_match = -1, .state = 0, .first = 0};
+            return;
+        }
+        e->length = 1;
+        e->first = data->character;
+        e->head = code;
+        e->state = pattern->delta[data->character];
+        e->last_match = (e->state == pattern->len) ? code : -1;
+        return;
+    }
+
+    search_entry *p = &(t->arr[data->prefix]);
+    e->length = p->length + 1;
+    e->first = p->first;
+    e->head = (e->length <= pattern->len) ? code : p->head;
+    e->state = pattern->delta[p->state * 256 + data->character];
+    e->last_match = (e->state == pattern->len) ? code : p->last_match;
+}
+
+/*Recomputes the metadata of every code, after the table was reset or pruned.
+Prefixes always precede the codes built on them, so one pass in code order suffices.*/
+void __search_table_rebuild(search_table *t, const search_pattern *pattern, decompression_strtable *table) {
+    for (int code = 0; (size_t) code < table->size; code++)
+        __search_table_add(t, pattern, table, code);
+}
+
+/*Adds (prefix, character) to a decoder's table along with its search metadata.*/
+static inline void __search_insert(search_table *t, const search_pattern *pattern, decompression_strtable *table, int prefix, int character) {
+    size_t size = table->size;
+    decompression_strtable_insert(table, prefix, character);
+    if (table->size > size)
+        __search_table_add(t, pattern, table, size);
+}
+
+/*Records a match ending end bytes past the current offset.*/
+static inline void __search_report(search_context *ctx, size_t end) {
+    char line[24];
+    int n = snprintf(line, sizeof(line), "%" PRIu64 "\n", ctx->offset + end - ctx->pattern->len);
+    binaryio_writer_put_bytes(ctx->out, (unsigned char *) line, n);
+    ctx->matches++;
+}
+
+/*Runs the automaton over the len bytes of a stored block.*/
+void __search_bytes(search_context *ctx, const unsigned char *bytes, size_t len) {
+    const unsigned short *delta = ctx->pattern->delta;
+    int m = ctx->pattern->len;
+    int state = ctx->state;
+
+    for (size_t i = 0; i < len; i++) {
+        state = delta[state * 256 + bytes[i]];
+        if (state == m)
+            __search_report(ctx, i + 1);
+    }
+
+    ctx->state = state;
+    ctx->offset += len;
+}
+
+/*Runs the automaton over a run of len copies of character.*/
+void __search_run(search_context *ctx, int character, size_t len) {
+    const unsigned short *delta = ctx->pattern->delta;
+    int m = ctx->pattern->len;
+    int state = ctx->state;
+
+    for (size_t i = 0; i < len; i++) {
+        state = delta[state * 256 + character];
+        if (state == m)
+            __search_report(ctx, i + 1);
+    }
+
+    ctx->state = state;
+    ctx->offset += len;
+}
+
+/*Advances the automaton over the string of a code without expanding all of it.*/
+static inline void __search_code(search_context *ctx, search_table *t, decompression_strtable *table, int code) {
+    const search_pattern *pattern = ctx->pattern;
+    search_entry *e = &(t->arr[code]);
+    int state = ctx->state;
+    int i = 0; // bytes of the string read so far
+
+    /*Once the automaton is no deeper than the bytes it has read, the prefix it tracks lies
+    within the string, so from then on it behaves exactly like a run from the start state.
+    That happens within the first pattern length bytes, so we only walk those.*/
+    if (state != 0) {
+        int k = t->arr[e->head].length;
+        int h = e->head;
+        for (int j = k - 1; j >= 0; j--) {
+            ctx->head[j] = table->arr[h].character;
+            h = table->arr[h].prefix;
+        }
+
+        while (i < k && state > i) {
+            state = pattern->delta[state * 256 + ctx->head[i++]];
+            if (state == pattern->len)
+                __search_report(ctx, i);
+        }
+
+        // a string shorter than the pattern can end before we catch up
+        if (state > i) {
+            ctx->state = state;
+            ctx->offset += e->length;
+            return;
+        }
+    }
+
+    // the matches past i are those of a run from the start state, which we find latest first
+    for (int c = e->last_match; c != -1 && t->arr[c].length > i; ) {
+        stack_push(ctx->ends, t->arr[c].length);
+        int prefix = table->arr[c].prefix;
+        c = (prefix == -1) ? -1 : t->arr[prefix].last_match;
+    }
+    while (ctx->ends->size > 0)
+        __search_report(ctx, stack_pop(ctx->ends));
+
+    ctx->state = e->state;
+    ctx->offset += e->length;
+}
+
+/*Searches the out_len bytes a sub-stream of in_len bytes at in decodes to, keeping the
+sub-stream's decoder in step exactly like `lzw_decoder_decode` would.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the sub-stream is malformed.*/
+int __search_stream(search_context *ctx, int s, const unsigned char *in, size_t in_len, size_t out_len) {
+    lzw_decoder *decoder = ctx->decoders->decoders[s];
+    search_table *t = ctx->tables[s];
+    const search_pattern *pattern = ctx->pattern;
+
+    binaryio_reader reader;
+    binaryio_reader_init(&reader, in, in_len);
+
+    int old_code = -1; // -1 represents EMPTY
+    size_t pos = 0;
+
+    while (pos < out_len) {
+        decompression_strtable *table = decoder->table;
+        int code;
+        if (binaryio_reader_get(&reader, &code, lzw_code_bits(table->size + (old_code != -1), decoder->max_bits)) != 1)
+            return DECOMPRESS_ERR_TRUNCATED;
+
+        if (code == RUN_CODE) {
+            int run_char, run_length;
+            if (binaryio_reader_get(&reader, &run_char, CHAR_BIT) != 1
+                || binaryio_reader_get(&reader, &run_length, RUN_LENGTH_BITS) != 1)
+                return DECOMPRESS_ERR_TRUNCATED;
+
+            run_length += RUN_MIN_LENGTH;
+            if (pos + run_length > out_len)
+                return DECOMPRESS_ERR_OVERRUN;
+
+            __search_run(ctx, run_char, run_length);
+            pos += run_length;
+
+            if (old_code != -1)
+                __search_insert(t, pattern, table, old_code, run_char);
+            old_code = -1;
+            continue;
+        }
+
+        if (code < 0 || (size_t) code > table->size
+            || ((size_t) code == table->size && (old_code == -1 || table->size >= table->max_size)))
+            return DECOMPRESS_ERR_CODE;
+
+        /*The entry we owe the encoder is old_code followed by the first byte of code. Adding
+        it first changes nothing for codes we already have, and supplies the unknown one.*/
+        if (old_code != -1)
+            __search_insert(t, pattern, table, old_code, t->arr[(size_t) code < table->size ? code : old_code].first);
+
+        if (pos + t->arr[code].length > out_len)
+            return DECOMPRESS_ERR_OVERRUN;
+        __search_code(ctx, t, table, code);
+        pos += t->arr[code].length;
+
+        if (lzw_decoder_update(decoder)) {
+            old_code = code;
+        }
+        else {
+            // a pruned table was swapped in, so its codes need new metadata
+            if (decoder->table != table)
+                __search_table_rebuild(t, pattern, decoder->table);
+            old_code = -1;
+        }
+    }
+
+    return 0;
+}
+
+search_context *search_context_new(search_pattern *pattern, int max_bits, int streams, int flags) {
+    search_context *ctx = malloc(sizeof(search_context));
+    ctx->pattern = pattern;
+    ctx->decoders = decompress_context_new(max_bits, streams, flags);
+
+    for (int s = 0; s < streams; s++) {
+        size_t max_size = (size_t) 1 << max_bits;
+        search_table *t = malloc(sizeof(search_table));
+        t->arena = arena_new(max_size * sizeof(search_entry));
+        t->arr = arena_alloc(t->arena, max_size * sizeof(search_entry));
+        __search_table_rebuild(t, pattern, ctx->decoders->decoders[s]->table);
+        ctx->tables[s] = t;
+    }
+
+    ctx->state = 0;
+    ctx->offset = 0;
+    ctx->matches = 0;
+    ctx->ends = stack_new(1 << max_bits);
+    ctx->head = malloc(pattern->len);
+    ctx->out = binaryio_writer_new();
+    return ctx;
+}
+
+int search_block(search_context *ctx, const block_header *header, const unsigned char *payload) {
+    const unsigned char *ins[MAX_STREAMS];
+    size_t in_lens[MAX_STREAMS];
+    int streams = ctx->decoders->streams;
+
+    if (header->raw_size > BLOCK_SIZE || header->payload_size > BLOCK_PAYLOAD_MAX)
+        return DECOMPRESS_ERR_BLOCK;
+
+    if (header->type == BLOCK_STORED && header->payload_size == header->raw_size) {
+        __search_bytes(ctx, payload, header->raw_size);
+        return 0;
+    }
+
+    if (header->type != BLOCK_LZW || decompress_split_streams(payload, header->payload_size, streams, ins, in_lens) != 0)
+        return DECOMPRESS_ERR_BLOCK;
+
+    if (ctx->decoders->flags & STREAM_FLAG_INDEPENDENT) {
+        for (int s = 0; s < streams; s++) {
+            lzw_decoder_reset(ctx->decoders->decoders[s]);
+            __search_table_rebuild(ctx->tables[s], ctx->pattern, ctx->decoders->decoders[s]->table);
+        }
+    }
+
+    // the slices follow one another in the decompressed block, so we search them in order
+    for (int s = 0; s < streams; s++) {
+        size_t len = block_stream_offset(header->raw_size, streams, s + 1) - block_stream_offset(header->raw_size, streams, s);
+        int status = __search_stream(ctx, s, ins[s], in_lens[s], len);
+        if (status != 0)
+            return status;
+    }
+
+    return 0;
+}
+
+void search_context_free(search_context *ctx) {
+    for (int s = 0; s < ctx->decoders->streams; s++) {
+        arena_free(ctx->tables[s]->arena);
+        free(ctx->tables[s]);
+    }
+    decompress_context_free(ctx->decoders);
+    stack_free(ctx->ends);
+    free(ctx->head);
+    binaryio_writer_free(ctx->out);
+    free(ctx);
+}
+
+int search(const unsigned char *pattern, int len, uint64_t *matches) {
+    unsigned char header_buf[BLOCK_HEADER_SIZE];
+
+    stream_header s_header;
+    if (fread(header_buf, 1, STREAM_HEADER_SIZE, stdin) < STREAM_HEADER_SIZE)
+        return DECOMPRESS_ERR_TRUNCATED;
+    int header_status = decompress_read_header(&s_header, header_buf);
+    if (header_status != 0)
+        return header_status;
+
+    search_pattern *compiled = search_pattern_new(pattern, len);
+    search_context *ctx = search_context_new(compiled, s_header.max_bits, s_header.streams, s_header.flags);
+    arena *buffers = arena_new(BLOCK_PAYLOAD_MAX);
+    unsigned char *payload = arena_alloc(buffers, BLOCK_PAYLOAD_MAX);
+    int status = DECOMPRESS_ERR_TRUNCATED; // unless we reach the end block
+
+    while (fread(header_buf, 1, BLOCK_HEADER_SIZE, stdin) == BLOCK_HEADER_SIZE) {
+        block_header b_header;
+        block_header_unpack(&b_header, header_buf);
+
+        if (b_header.type == BLOCK_END) {
+            status = 0;
+            break;
+        }
+
+        if (b_header.payload_size > BLOCK_PAYLOAD_MAX) {
+            status = DECOMPRESS_ERR_BLOCK;
+            break;
+        }
+        if (fread(payload, 1, b_header.payload_size, stdin) < b_header.payload_size)
+            break;
+        int block_status = search_block(ctx, &b_header, payload);
+        if (block_status != 0) {
+            status = block_status;
+            break;
+        }
+
+        fwrite(ctx->out->data, 1, ctx->out->size, stdout);
+        binaryio_writer_reset(ctx->out);
+    }
+
+    *matches = ctx->matches;
+
+    arena_free(buffers);
+    search_context_free(ctx);
+    search_pattern_free(compiled);
+
+    return status;
+}
@@ -0,0 +1,109 @@
+/*
+Search for a literal pattern in a compressed stream without decompressing it.
+
+The codes are read and the decoder's string tables are kept in step with the encoder's as
+usual, but codes are never expanded into bytes. Instead, each code carries a little metadata
+about its string, computed from its prefix's when the code is added to the table: its length,
+its first byte, the state a KMP automaton for the pattern ends in after reading the string,
+and where inside the string that automaton completed a match. A code can then be matched in
+constant time when the automaton is in its start state, which is nearly always the case,
+and in at most pattern length steps otherwise.
+*/
+#ifndef SEARCH
+#define SEARCH
+#include <stdint.h>
+#include <stddef.h>
+#include "decompress.h"
+#include "string_table.h"
+#include "stack.h"
+#include "arena.h"
+
+#define SEARCH_PATTERN_MAX 1024 // Longest pattern we build an automaton for.
+
+/*
+A literal pattern compiled into a KMP automaton. A state is the length of the longest prefix
+of the pattern that the input read so far ends with, so state len means a match just ended.
+*/
+struct search_pattern {
+    unsigned char *bytes;
+    int len;
+
+    unsigned short *delta; // delta[state * 256 + byte] is the state after reading byte
+};
+
+typedef struct search_pattern search_pattern;
+
+/*What we know about the string of one code, for a given pattern.*/
+struct search_entry {
+    int length;
+    int head; // the code's ancestor whose string is its first min(length, pattern length) bytes
+    int last_match; // the closest ancestor, or the code itself, at whose last byte a match ends, or -1
+    unsigned short state; // the automaton's state after reading the string from the start state
+    unsigned char first;
+};
+
+typedef struct search_entry search_entry;
+
+/*Search metadata for every code of one decoder's string table, indexed on the code.*/
+struct search_table {
+    search_entry *arr;
+    arena *arena;
+};
+
+typedef struct search_table search_table;
+
+/*
+Everything needed to search a stream: a decoder and search table per sub-stream, and the
+automaton's progress through the decompressed data.
+*/
+struct search_context {
+    search_pattern *pattern;
+    decompress_context *decoders;
+    search_table *tables[MAX_STREAMS];
+
+    int state; // the automaton's state at offset
+    uint64_t offset; // decompressed bytes searched so far
+    uint64_t matches;
+
+    stack *ends; // scratch space for ordering the matches within a code
+    unsigned char *head; // scratch space for the leading bytes of a code
+    binaryio_writer *out; // offsets found in the current block
+};
+
+typedef struct search_context search_context;
+
+/*
+Compiles a pattern of len bytes, 1 <= len <= SEARCH_PATTERN_MAX.
+The returned pattern is dynamically allocated and therefore must be freed.
+*/
+search_pattern *search_pattern_new(const unsigned char *bytes, int len);
+
+// Frees a compiled pattern.
+void search_pattern_free(search_pattern *pattern);
+
+/*
+Constructs a context searching for pattern in a stream with the given settings and STREAM_FLAG_* flags.
+The context doesn't own the pattern. The returned context is dynamically allocated
+and therefore must be freed.
+*/
+search_context *search_context_new(search_pattern *pattern, int max_bits, int streams, int flags);
+
+/*
+Searches one block, given its header and payload, appending the decimal offset of every
+match that ends in it to ctx->out, one per line.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the block is malformed.
+*/
+int search_block(search_context *ctx, const block_header *header, const unsigned char *payload);
+
+// Frees a context and everything it holds.
+void search_context_free(search_context *ctx);
+
+/*
+Reads a stream outputted from a call to `compress()` from stdin and prints the decompressed
+byte offset of every occurrence of the len byte pattern, overlapping ones included.
+The number of occurrences is stored in matches.
+Returns 0 on success, or a DECOMPRESS_ERR_* code if the stream is malformed.
+*/
+int search(const unsigned char *pattern, int len, uint64_t *matches);
+
+#endif
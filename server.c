@@ -0,0 +1,244 @@
+#include "server.h"
+#include "compress.h"
+#include "decompress.h"
+#include "format.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*State owned by one worker thread. Nothing here is shared, so requests need no locking.*/
+struct server_worker {
+    pthread_t thread;
+    int listen_fd;
+
+    compress_context *c_ctx; // set up for the settings of the last compress request
+    decompress_context *d_ctx;
+    int max_bits; // the server's settings, for requests that don't bring their own
+    int streams;
+
+    unsigned char *request; // payload of the current request
+    size_t request_capacity;
+    binaryio_writer *response; // frame header and payload of the current response
+};
+
+typedef struct server_worker server_worker;
+
+int server_read_full(int fd, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, (unsigned char *) buf + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return (n == 0 && done == 0) ? 0 : -1;
+        done += n;
+    }
+    return 1;
+}
+
+int server_write_full(int fd, const void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        // MSG_NOSIGNAL keeps a client that hung up from killing us with SIGPIPE
+        ssize_t n = send(fd, (const unsigned char *) buf + done, len - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+/*Adds up the sizes the blocks of a compressed stream claim to decompress to, stopping at the end
+block or at the end of the stream. decompress_block fills exactly that many bytes per block, so
+this bounds the size of the response before any of it is decoded.*/
+uint64_t __server_decompressed_size(const unsigned char *in, size_t len) {
+    uint64_t total = 0;
+    size_t offset = STREAM_HEADER_SIZE;
+    while (offset <= len && len - offset >= BLOCK_HEADER_SIZE) {
+        block_header b_header;
+        block_header_unpack(&b_header, in + offset);
+        if (b_header.type == BLOCK_END)
+            break;
+        total += b_header.raw_size;
+        offset += BLOCK_HEADER_SIZE + (size_t) b_header.payload_size;
+    }
+    return total;
+}
+
+/*Returns the worker's compression context, reset and set up for the given settings. The
+context is only replaced when the settings differ from the last request's, so clients that
+keep to one setting don't make us allocate.*/
+compress_context *__server_compress_context(server_worker *worker, int max_bits, int streams) {
+    if (worker->c_ctx->max_bits != max_bits || worker->c_ctx->streams != streams) {
+        compress_context_free(worker->c_ctx);
+        worker->c_ctx = compress_context_new(max_bits, streams, 0);
+    }
+    else {
+        compress_context_reset(worker->c_ctx);
+    }
+    return worker->c_ctx;
+}
+
+/*Runs one request through the worker's codec, leaving the response frame in worker->response.*/
+void __server_handle(server_worker *worker, int op, size_t len) {
+    binaryio_writer *response = worker->response;
+    int status = SERVER_STATUS_OK;
+
+    // we leave room for the frame header and fill it in once the payload size is known
+    binaryio_writer_reset(response);
+    binaryio_writer_reserve(response, SERVER_FRAME_HEADER_SIZE);
+    response->size = SERVER_FRAME_HEADER_SIZE;
+
+    if (op == SERVER_OP_COMPRESS) {
+        compress_context *ctx = __server_compress_context(worker, worker->max_bits, worker->streams);
+        compress_buffer(ctx, worker->request, len, response);
+    }
+    else if (op == SERVER_OP_COMPRESS_SETTINGS) {
+        int max_bits = (len >= SERVER_SETTINGS_SIZE) ? worker->request[0] : 0;
+        int streams = (len >= SERVER_SETTINGS_SIZE) ? worker->request[1] : 0;
+        if (max_bits < MAX_BITS_LB || max_bits > MAX_BITS_UB || streams < 1 || streams > MAX_STREAMS) {
+            status = SERVER_STATUS_ERROR;
+        }
+        else {
+            compress_context *ctx = __server_compress_context(worker, max_bits, streams);
+            compress_buffer(ctx, worker->request + SERVER_SETTINGS_SIZE, len - SERVER_SETTINGS_SIZE, response);
+        }
+    }
+    else if (op == SERVER_OP_DECOMPRESS) {
+        // responses are capped like requests, so a small stream of long runs can't make us
+        // allocate without bound
+        if (__server_decompressed_size(worker->request, len) > SERVER_MAX_PAYLOAD)
+            status = SERVER_STATUS_ERROR;
+        else if (decompress_buffer(worker->d_ctx, worker->request, len, response) != 0)
+            status = SERVER_STATUS_ERROR;
+    }
+    else {
+        status = SERVER_STATUS_ERROR;
+    }
+
+    if (status != SERVER_STATUS_OK)
+        response->size = SERVER_FRAME_HEADER_SIZE;
+
+    response->data[0] = status;
+    pack_u32(response->size - SERVER_FRAME_HEADER_SIZE, response->data + 1);
+}
+
+/*Answers requests on a connection until the client closes it or breaks the protocol.*/
+void __server_serve_connection(server_worker *worker, int fd) {
+    unsigned char frame[SERVER_FRAME_HEADER_SIZE];
+
+    while (server_read_full(fd, frame, SERVER_FRAME_HEADER_SIZE) == 1) {
+        size_t len = unpack_u32(frame + 1);
+
+        if (len > SERVER_MAX_PAYLOAD) {
+            frame[0] = SERVER_STATUS_ERROR;
+            pack_u32(0, frame + 1);
+            server_write_full(fd, frame, SERVER_FRAME_HEADER_SIZE);
+            return;
+        }
+
+        // the request buffer only ever grows, so steady traffic doesn't allocate
+        if (len > worker->request_capacity) {
+            worker->request_capacity = len;
+            worker->request = realloc(worker->request, len);
+        }
+        if (server_read_full(fd, worker->request, len) != 1)
+            return;
+
+        __server_handle(worker, frame[0], len);
+        if (server_write_full(fd, worker->response->data, worker->response->size) != 0)
+            return;
+    }
+}
+
+void *__server_worker_main(void *arg) {
+    server_worker *worker = arg;
+
+    // every worker accepts on the shared listening socket, so idle workers pick up new clients
+    while (1) {
+        int fd = accept(worker->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("compressd: accept");
+            return NULL;
+        }
+
+        __server_serve_connection(worker, fd);
+        close(fd);
+    }
+}
+
+int server_run(const char *socket_path, int workers, int max_bits, int streams) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "compressd: socket path is too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // a socket left behind by an earlier run would make bind fail, but anything else at the
+    // path is most likely a mistyped argument and must not be deleted
+    struct stat st;
+    if (lstat(socket_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "compressd: %s exists and is not a socket\n", socket_path);
+            return -1;
+        }
+        unlink(socket_path);
+    }
+    else if (errno != ENOENT) {
+        perror("compressd");
+        return -1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(listen_fd, 128) != 0) {
+        perror("compressd");
+        return -1;
+    }
+
+    server_worker *pool = calloc(workers, sizeof(server_worker));
+    for (int i = 0; i < workers; i++) {
+        server_worker *worker = &pool[i];
+        worker->listen_fd = listen_fd;
+        worker->c_ctx = compress_context_new(max_bits, streams, 0);
+        worker->max_bits = max_bits;
+        worker->streams = streams;
+        worker->d_ctx = decompress_context_new(max_bits, streams, 0);
+        worker->request_capacity = BLOCK_SIZE;
+        worker->request = malloc(worker->request_capacity);
+        worker->response = binaryio_writer_new();
+        int error = pthread_create(&worker->thread, NULL, __server_worker_main, worker);
+        if (error != 0) {
+            // we leave the workers that did start to the exit that follows
+            fprintf(stderr, "compressd: pthread_create: %s\n", strerror(error));
+            unlink(socket_path);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < workers; i++)
+        pthread_join(pool[i].thread, NULL);
+
+    // the workers only stop when accept fails
+    for (int i = 0; i < workers; i++) {
+        compress_context_free(pool[i].c_ctx);
+        decompress_context_free(pool[i].d_ctx);
+        free(pool[i].request);
+        binaryio_writer_free(pool[i].response);
+    }
+    free(pool);
+    close(listen_fd);
+    unlink(socket_path);
+    return -1;
+}
@@ -0,0 +1,45 @@
+/*
+Compression service over a Unix domain socket, so that callers with many small payloads
+don't pay for a process start and fresh string tables on every request.
+
+Requests and responses are length-prefixed frames on a stream socket:
+    request:  [1 byte operation][4 byte big-endian length][payload]
+    response: [1 byte status][4 byte big-endian length][payload]
+A connection may carry any number of requests, which are answered in order.
+Compress requests are coded with the settings the server was started with, unless they use
+SERVER_OP_COMPRESS_SETTINGS, whose payload starts with the MAXBITS and STREAMS to code the rest
+with, one byte each. Decompress requests accept any stream produced by `compress`.
+*/
+#ifndef SERVER
+#define SERVER
+#include <stddef.h>
+
+#define SERVER_OP_COMPRESS 'c'
+#define SERVER_OP_DECOMPRESS 'd'
+#define SERVER_OP_COMPRESS_SETTINGS 'C'
+#define SERVER_SETTINGS_SIZE 2 // MAXBITS and STREAMS in front of a SERVER_OP_COMPRESS_SETTINGS payload
+
+#define SERVER_STATUS_OK 0
+#define SERVER_STATUS_ERROR 1
+
+#define SERVER_FRAME_HEADER_SIZE 5
+#define SERVER_MAX_PAYLOAD (64 << 20) // Larger requests, and decompress requests that would decode to more, are rejected.
+
+/*
+Reads exactly len bytes from fd into buf, retrying on short reads.
+Returns 1 on success, 0 if the connection was closed before any byte was read and -1 otherwise.
+*/
+int server_read_full(int fd, void *buf, size_t len);
+
+// Writes exactly len bytes from buf to fd. Returns 0 on success and -1 otherwise.
+int server_write_full(int fd, const void *buf, size_t len);
+
+/*
+Listens on the Unix socket at `socket_path`, replacing a socket left there by an earlier run but
+refusing to touch any other kind of file, and serves requests with a pool of `workers` threads.
+Every worker owns a compression and a decompression context (string tables and buffers) that are
+allocated once and reset between requests. Only returns if the socket can't be set up, returning -1.
+*/
+int server_run(const char *socket_path, int workers, int max_bits, int streams);
+
+#endif
@@ -3,10 +3,11 @@
 #include <stdlib.h>
 #include "stack.h"
 
-stack *stack_new() {
+stack *stack_new(int capacity) {
     stack *st = malloc(sizeof(stack));
     st->size = 0;
-    st->head = NULL;
+    st->capacity = capacity > 0 ? capacity : 1;
+    st->data = malloc(st->capacity * sizeof(int));
 
     return st;
 }
@@ -14,28 +15,18 @@ stack *stack_new() {
 void stack_push(stack *stack, int data) {
     if (stack != NULL) {
         
-        node *n = malloc(sizeof(node)); 
-        n->data = data;
-        n->next = stack->head; 
+        if (stack->size == stack->capacity) {
+            stack->capacity *= 2;
+            stack->data = realloc(stack->data, stack->capacity * sizeof(int));
+        }
 
-        stack->head = n; 
-        stack->size++;
+        stack->data[stack->size++] = data;
     }
 }
 
 int stack_pop(stack *stack) {
-    if (stack != NULL && stack->head != NULL) {
-
-        // store data to return
-        int data = stack->head->data;
-        node *node = stack->head;
-
-        // move pointers to remove current head
-        stack->head = stack->head->next;
-        stack->size--;
-        free(node);
-    
-        return data; 
+    if (stack != NULL && stack->size > 0) {
+        return stack->data[--stack->size];
     }
 
     return -1;
@@ -43,16 +34,8 @@ int stack_pop(stack *stack) {
 
 void stack_free(stack *stack) {
     if (stack != NULL) {
-        while (stack->head) { // free linked list
-            node *n = stack->head;
-            stack->head = stack->head->next;
-            free(n);
-        }
+        free(stack->data);
     }
 
     free(stack); 
 }
-
-
-
-
@@ -1,5 +1,5 @@
 /*
-Linked-list based stack implementation in C. 
+Array based stack implementation in C. 
 */
 #ifndef STACK
 #define STACK
@@ -10,24 +10,19 @@ Linked-list based stack implementation in C.
 
 // DATA DEFINITIONS
 
-struct node {
-    int data;
-    struct node *next;
-}; 
-
-typedef struct node node; 
-
 struct stack {
-    node *head;
+    int *data;
     int size; 
+    int capacity;
 }; 
 
 typedef struct stack stack;
 
 // METHODS
 
-// constructs a new empty stack
-stack *stack_new();
+// constructs a new empty stack with room for capacity elements
+// a stack that needs more room grows, but stacks sized for their worst case never allocate again
+stack *stack_new(int capacity);
 
 // pushes data to the top of the stack
 void stack_push(stack *stack, int data);
@@ -40,4 +35,4 @@ int stack_pop(stack *stack);
 // frees a stack
 void stack_free(stack *stack);
 
-#endif
\ No newline at end of file
+#endif
@@ -28,34 +28,16 @@ u_int64_t __hash_func(int prefix, int character) {
     return hash; 
 }
 
-/*Creates a dynamically-allocated deep copy of entry.*/
-strtable_entry *__deepcopy_strtable_entry(strtable_entry *entry) {
-    strtable_entry *copy = malloc(sizeof(strtable_entry));
-    copy->character = entry->character;
-    copy->prefix = entry->prefix;
-    copy->code = entry->code;
-    return copy; 
-}
-
 /*Converts a hash-table based string table to an array based string table. 
 The returned table can therefore be traversed sequentially by code.*/
 decompression_strtable *__compression_to_decompression_strtable(compression_strtable *table) {
 
     decompression_strtable *decompress_table = decompression_strtable_new(table->max_size); 
 
-
-    for (int i = 0; i < table->num_buckets; i++) {
-
-        hashed_strtable_entry *bucket = table->buckets[i];
-
-        while (bucket) { // traverse each bucket
-
-            decompress_table->arr[bucket->data.code] = bucket->data;
-
-            decompress_table->size++;
-            bucket = bucket->next; 
-        }
+    for (size_t i = 0; i < table->size; i++) {
+        decompress_table->arr[i] = table->entries[i].data;
     }
+    decompress_table->size = table->size;
 
     return decompress_table;
 }
@@ -66,21 +48,64 @@ COMPRESSION STRING TABLE
 ===============================================================================
 */
 
+/*Once a table holds this many codes, its entries and buckets take up more than a huge page,
+so from then on its arena is backed by huge pages.*/
+#define COMPRESSION_HUGE_PAGE_CODES (ARENA_HUGE_PAGE_SIZE / (sizeof(hashed_strtable_entry) + sizeof(int)))
+
+/*The most buckets a table ever gets: 1.33x the max number of entries.*/
+size_t __max_buckets(size_t max_size) {
+    return (4*max_size)/3;
+}
+
+/*Empties a table and spreads it over num_buckets buckets.*/
+void __compression_strtable_clear(compression_strtable *table, size_t num_buckets) {
+    table->size = 0;
+    table->num_buckets = num_buckets;
+    memset(table->buckets, 0xff, num_buckets * sizeof(int)); // every bucket starts out as -1
+}
+
+/*Puts the entry for code at the front of its bucket.*/
+static inline void __compression_strtable_link(compression_strtable *table, int code) {
+    hashed_strtable_entry *node = &(table->entries[code]);
+    size_t index = __hash_func(node->data.prefix, node->data.character) % table->num_buckets;
+    node->next = table->buckets[index];
+    table->buckets[index] = code;
+}
+
+/*Doubles the number of buckets (up to the maximum) and redistributes the entries over them.
+The bucket array was reserved at its largest size, so this happens in place.*/
+void __compression_strtable_grow(compression_strtable *table) {
+    size_t num_buckets = table->num_buckets * 2;
+    if (num_buckets > __max_buckets(table->max_size))
+        num_buckets = __max_buckets(table->max_size);
+
+    size_t size = table->size;
+    __compression_strtable_clear(table, num_buckets);
+    for (table->size = 0; table->size < size; table->size++)
+        __compression_strtable_link(table, table->size);
+}
+
+/*The arena a table with max_size codes is carved out of: entries, buckets and prune scratch.*/
+size_t __compression_strtable_arena_size(size_t max_size) {
+    return arena_size(max_size * sizeof(hashed_strtable_entry))
+        + arena_size(__max_buckets(max_size) * sizeof(int))
+        + arena_size(max_size * sizeof(int));
+}
+
 compression_strtable *compression_strtable_new(size_t max_size) {
     compression_strtable *table = malloc(sizeof(compression_strtable)); 
 
-    // We set the hash table size to be 1.33x the max number of entries.
-    size_t num_buckets = (4*max_size)/3; 
-
     // initialize fields
-    table->num_buckets = num_buckets; 
-    table->size = 0; 
     table->max_size = max_size;
-    table->buckets = malloc(num_buckets*sizeof(hashed_strtable_entry*));
+    table->arena = arena_new(__compression_strtable_arena_size(max_size));
+    table->entries = arena_alloc(table->arena, max_size * sizeof(hashed_strtable_entry));
+    table->buckets = arena_alloc(table->arena, __max_buckets(max_size) * sizeof(int));
+    table->scratch = arena_alloc(table->arena, max_size * sizeof(int));
 
-    for (int i = 0; i < num_buckets; i++) {
-        table->buckets[i] = NULL; // initialize all buckets with NULL
-    }
+    size_t num_buckets = STRTABLE_INITIAL_BUCKETS;
+    if (num_buckets > __max_buckets(max_size))
+        num_buckets = __max_buckets(max_size);
+    __compression_strtable_clear(table, num_buckets);
 
     return table;
 }
@@ -92,41 +117,37 @@ void compression_strtable_insert(compression_strtable *table, int prefix, int ch
         return; 
     }
 
-    u_int64_t hash = __hash_func(prefix, character); 
-    size_t index = hash % table->num_buckets; 
-
-    hashed_strtable_entry *node = malloc(sizeof(hashed_strtable_entry)); 
+    // We keep the load factor at or below 3/4.
+    if (4*(table->size + 1) > 3*table->num_buckets && table->num_buckets < __max_buckets(table->max_size)) {
+        __compression_strtable_grow(table);
+    }
+    if (table->size == COMPRESSION_HUGE_PAGE_CODES)
+        arena_use_huge_pages(table->arena);
 
-    node->next = NULL;
-    node->data = (strtable_entry) {
+    // entries are stored at their code, so we never allocate a node
+    table->entries[table->size].data = (strtable_entry) {
         .character = character,
         .prefix = prefix,
-        .code = table->size++
+        .code = table->size
     }; 
-
-    hashed_strtable_entry *bucket = table->buckets[index]; 
-    if (!bucket) // if bucket is empty
-        table->buckets[index] = node;
-    else { // puts node in the front of the list
-        node->next = bucket; 
-        table->buckets[index] = node; 
-    }
+    __compression_strtable_link(table, table->size++);
 }
 
 strtable_entry *compression_strtable_get(compression_strtable *table, int prefix, int character) {
 
     // we first get the bucket the code lives in
     u_int64_t hash = __hash_func(prefix, character); 
-    hashed_strtable_entry *bucket = table->buckets[hash % table->num_buckets]; 
+    int code = table->buckets[hash % table->num_buckets]; 
     
 
     // then we sequentially check each node to see if the 
     // (prefix, character) pairs match to get the right code
-    while (bucket != NULL) {
-        if (bucket->data.prefix == prefix && bucket->data.character == character) {
-            return &(bucket->data);
+    while (code != -1) {
+        hashed_strtable_entry *node = &(table->entries[code]);
+        if (node->data.prefix == prefix && node->data.character == character) {
+            return &(node->data);
         } 
-        bucket = bucket->next;
+        code = node->next;
     }
 
     return NULL; // we return -1 if there is no match
@@ -134,73 +155,43 @@ strtable_entry *compression_strtable_get(compression_strtable *table, int prefix
     // empty because we never store (the code) -1 in the string table
 }
 
-compression_strtable *compression_strtable_prune(compression_strtable *original) {
+void compression_strtable_prefetch(compression_strtable *table, int prefix, int character) {
+    u_int64_t hash = __hash_func(prefix, character); 
+    __builtin_prefetch(&(table->buckets[hash % table->num_buckets]));
+}
 
-    // we want to be able to get the prefix, character pair
-    // based on the code, so we create a decode array to help with that
-    decompression_strtable *decompress_table = __compression_to_decompression_strtable(original); 
+void compression_strtable_prune(compression_strtable *original, compression_strtable *pruned) {
 
     // we first find the codes that we will keep
-    // by traversing the entire hash table
-    int *codes_to_keep = calloc(original->size, sizeof(int));
-
-    // although we don't formally need this
-    // keeping track of the pruned size adds minimal overhead
-    // and is helpful for debugging
-    int pruned_size = 0; 
-
-    for (int i = 0; i < original->num_buckets; i++) {
-
-        hashed_strtable_entry *bucket = original->buckets[i];
-
-        while (bucket) {
-
-            int prefix = bucket->data.prefix;
-            if (prefix == -1) {
-                if (codes_to_keep[bucket->data.character] == 0) {
-                    codes_to_keep[bucket->data.character] = 1;
-                    pruned_size++;
-                }
-            }
-            else if (codes_to_keep[prefix] == 0) {
-                codes_to_keep[prefix] = 1; 
-                pruned_size++; 
-            }
-
-            bucket = bucket->next; 
-        }
+    // by traversing the entire table
+    // the same array later maps the old codes to the new codes
+    int *codes = original->scratch;
+    memset(codes, 0, original->size * sizeof(int));
+
+    for (size_t i = 0; i < original->size; i++) {
+        strtable_entry *data = &(original->entries[i].data);
+        if (data->prefix == -1)
+            codes[data->character] = 1;
+        else
+            codes[data->prefix] = 1;
     }
 
-    // now we need to reconstruct the hash table
-
-    // we maintain a mapping of the old codes to the new codes
-    // since some codes may change
-    // the index of the array represents the old code
-    // and the value of the array element represents the new code
-    int *old_to_new_codes = calloc(original->size, sizeof(int));
-
-    compression_strtable *pruned_table = compression_strtable_new(original->max_size); 
+    // the pruned table will fill up again, so it starts out with as many buckets as the original
+    __compression_strtable_clear(pruned, original->num_buckets);
 
     // now we populate the pruned hash table
-    for (int i = 0; i < original->size; i++) {
-        if (codes_to_keep[i]) { // we should keep this code
-            strtable_entry data = decompress_table->arr[i]; // we get the prefix, character pair
-            old_to_new_codes[i] = pruned_table->size;
+    // prefixes come before the codes built on them, so their new codes are known by then
+    for (size_t i = 0; i < original->size; i++) {
+        if (codes[i]) { // we should keep this code
+            strtable_entry data = original->entries[i].data; // we get the prefix, character pair
+            codes[i] = pruned->size;
 
             if (data.prefix == -1) // it is one of the 256 base characters
-                compression_strtable_insert(pruned_table, data.prefix, data.character);
+                compression_strtable_insert(pruned, data.prefix, data.character);
             else // we need to account for the fact that the prefix code may have changed
-                compression_strtable_insert(pruned_table, old_to_new_codes[data.prefix], data.character);
+                compression_strtable_insert(pruned, codes[data.prefix], data.character);
         }
     }
-
-    // we free the decode arr we made
-    decompression_strtable_free(decompress_table); 
-    free(old_to_new_codes);
-    free(codes_to_keep);
-
-    return pruned_table;
-
 }
 
 void compression_strtable_dump(compression_strtable *table, char *filename) {
@@ -213,30 +204,47 @@ void compression_strtable_dump(compression_strtable *table, char *filename) {
     decompression_strtable_free(decompress_table);
 }
 
+void compression_strtable_reset(compression_strtable *table) {
+    __compression_strtable_clear(table, table->num_buckets);
+}
+
 void compression_strtable_free(compression_strtable *table) {
-    for (int i = 0; i < table->num_buckets; i++) {
-        hashed_strtable_entry* bucket = table->buckets[i];
-        while (bucket) {
-            hashed_strtable_entry *next = bucket->next;
-            free(bucket);
-            bucket = next; 
-        }
-    }
-    free(table->buckets); 
+    arena_free(table->arena);
     free(table); 
 }
 
+size_t compression_strtable_memory(size_t max_size) {
+    return arena_footprint(__compression_strtable_arena_size(max_size));
+}
+
 /*
 ===============================================================================
 DECOMPRESSION STRING TABLE
 ===============================================================================
 */
 
+/*Once a table holds this many codes, its entries and strings take up more than a huge page,
+so from then on its arena is backed by huge pages.*/
+#define DECOMPRESSION_HUGE_PAGE_CODES (ARENA_HUGE_PAGE_SIZE / (sizeof(strtable_entry) + sizeof(strtable_string)))
+
+/*The arena a table with max_size codes is carved out of: entries and strings, each with the
+sentinel in front, and prune scratch.*/
+size_t __decompression_strtable_arena_size(size_t max_size) {
+    return arena_size((max_size + 1) * sizeof(strtable_entry)) + arena_size((max_size + 1) * sizeof(strtable_string))
+        + arena_size(max_size * sizeof(int));
+}
+
 decompression_strtable *decompression_strtable_new(size_t max_size) {
     decompression_strtable* table = malloc(sizeof(decompression_strtable)); 
     table->size = 0; 
     table->max_size = max_size; 
-    table->arr = calloc(max_size, sizeof(strtable_entry)); 
+    table->arena = arena_new(__decompression_strtable_arena_size(max_size));
+    table->arr = (strtable_entry *) arena_alloc(table->arena, (max_size + 1) * sizeof(strtable_entry)) + 1;
+    table->strings = (strtable_string *) arena_alloc(table->arena, (max_size + 1) * sizeof(strtable_string)) + 1;
+    table->scratch = arena_alloc(table->arena, max_size * sizeof(int));
+
+    table->arr[-1] = (strtable_entry) {.prefix = -1, .character = 0, .code = -1};
+    table->strings[-1] = (strtable_string) {.length = 0, .first = 0};
     return table; 
 }
 
@@ -246,75 +254,75 @@ void decompression_strtable_insert(decompression_strtable *table, int prefix, in
         return; 
     }
     table->arr[table->size] = (strtable_entry) {.prefix = prefix, .character = character, .code = table->size};   
+
+    // the sentinel's length of 0 makes single characters come out at 1
+    strtable_string *p = &(table->strings[prefix]);
+    table->strings[table->size] = (strtable_string) {.length = p->length + 1, .first = (prefix == -1) ? character : p->first};
     table->size++;  
+
+    if (table->size == DECOMPRESSION_HUGE_PAGE_CODES)
+        arena_use_huge_pages(table->arena);
 }
 
 strtable_entry *decompression_strtable_get(decompression_strtable* table, int code) {
-    if (code < 0 || code >= table->size)
+    if (code < 0 || (size_t) code >= table->size)
         return NULL;
     return &(table->arr[code]); 
 }
 
-decompression_strtable *decompression_strtable_prune(decompression_strtable *original) {
+void decompression_strtable_prune(decompression_strtable *original, decompression_strtable *pruned) {
     // we first find the codes that we will keep
     // by traversing the entire array
-    int *codes_to_keep = calloc(original->size, sizeof(int));
-
-    // although we don't formally need this
-    // keeping track of the pruned size adds minimal overhead
-    // and is helpful for debugging
-    int pruned_size = 0;
+    // the same array later maps the old codes to the new codes
+    int *codes = original->scratch;
+    memset(codes, 0, original->size * sizeof(int));
 
-    for (int i = 0; i < original->size; i++) {
+    for (size_t i = 0; i < original->size; i++) {
         int prefix = original->arr[i].prefix;
 
-        if (prefix == -1 && codes_to_keep[original->arr[i].character] == 0) {
-            codes_to_keep[original->arr[i].character] = 1; 
-            pruned_size++; 
-        }
-        else if (codes_to_keep[prefix] == 0) {
-            codes_to_keep[prefix] = 1;
-            pruned_size++;
-        }
+        if (prefix == -1)
+            codes[original->arr[i].character] = 1; 
+        else
+            codes[prefix] = 1;
     }
 
     // we'll now reconstruct the array
-
-    decompression_strtable *pruned_table = decompression_strtable_new(original->max_size); 
-
-    // we maintain a mapping of the old codes to the new codes
-    // since some codes may change
-    int *old_to_new_codes = calloc(original->size, sizeof(int));
+    pruned->size = 0;
 
     // now we populate the pruned array
-    for (int i = 0; i < original->size; i++) {
-        if (codes_to_keep[i]) { // we should keep this code
+    for (size_t i = 0; i < original->size; i++) {
+        if (codes[i]) { // we should keep this code
             strtable_entry data = original->arr[i]; // we get the prefix, character pair
-            old_to_new_codes[i] = pruned_table->size;
+            codes[i] = pruned->size;
 
             // we may have to adjust the prefix since codes can change
-            int prefix = data.prefix == -1 ? data.prefix : old_to_new_codes[data.prefix]; 
+            int prefix = data.prefix == -1 ? data.prefix : codes[data.prefix]; 
 
-            decompression_strtable_insert(pruned_table, prefix, data.character); 
+            decompression_strtable_insert(pruned, prefix, data.character); 
         }
     }
-    free(old_to_new_codes);
-    free(codes_to_keep);
-    return pruned_table;
+}
 
+void decompression_strtable_reset(decompression_strtable *table) {
+    // entries past size are never read, so there is no need to clear them
+    table->size = 0;
 }
 
 void decompression_strtable_free(decompression_strtable* table) {
-    free(table->arr); 
+    arena_free(table->arena);
     free(table);
 }
 
+size_t decompression_strtable_memory(size_t max_size) {
+    return arena_footprint(__decompression_strtable_arena_size(max_size));
+}
+
 
 void decompression_strtable_dump(decompression_strtable* arr, char *filename) {
     FILE *file = fopen(filename, "w"); 
     fprintf(file, "String Table Dump\n");
     fprintf(file, "%-8s\t%-8s\t%-12s\t%-8s\n", "Code", "Prefix", "Character", "String");
-    for (int i = 0; i < arr->size; i++) {
+    for (int i = 0; i < (int) arr->size; i++) {
         // we first convert all the prefixes to their base characters
         int prefix = i; 
         int length = 0; 
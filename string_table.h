@@ -3,9 +3,13 @@
 #define FNV_PRIME_64 0x00000100000001b3
 #define FNV_OFFSET_BASIS_64 0xcbf29ce484222325
 
+// The bucket array starts out this large and grows geometrically up to what max_size needs.
+#define STRTABLE_INITIAL_BUCKETS 512
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "arena.h"
 
 struct strtable_entry {
     int prefix;
@@ -17,39 +21,66 @@ typedef struct strtable_entry strtable_entry;
 
 struct hashed_strtable_entry {
     strtable_entry data;
-    struct hashed_strtable_entry *next; 
-    
+    int next; // code of the next entry in the same bucket, or -1
 };
 
 typedef struct hashed_strtable_entry hashed_strtable_entry; 
 
+/*The length and first byte of the string a code stands for, which let the decoder
+bounds check and expand a code without walking its prefixes first.*/
+struct strtable_string {
+    int length;
+    int first;
+};
+
+typedef struct strtable_string strtable_string;
+
 /*Implementation of the string table for compression, using FNV-1a hashing of a 
-(prefix, character) pair to get the associated code.*/
+(prefix, character) pair to get the associated code. The bucket array doubles whenever the
+table gets more than 3/4 full, until it reaches 1.33x max_size buckets.
+All of its memory comes from an arena sized for max_size codes when the table is
+constructed, so inserting, growing and pruning never allocate. Once the table outgrows a huge
+page, the arena is asked for huge pages (see arena.h).*/
 struct compression_strtable {
     size_t size;
     size_t max_size; 
 
     size_t num_buckets;
-    hashed_strtable_entry **buckets; 
+    int *buckets; // code of the first entry in each bucket, or -1
+
+    hashed_strtable_entry *entries; // indexed on the code
+    int *scratch; // bookkeeping for pruning, one int per code
+
+    arena *arena;
 };
 
 typedef struct compression_strtable compression_strtable; 
 
 
 /*Implementation of the string table for decompression, using an array of
-(prefix, character) pairs indexed on the code for fast lookup given a code.*/
+(prefix, character) pairs indexed on the code for fast lookup given a code.
+Like the compression table, it never allocates once constructed, and asks for huge pages
+once it outgrows one.
+Both arrays have a sentinel at index -1, the prefix of every single character string:
+an entry with prefix -1 and a string of length 0. Following a prefix chain one step too
+far therefore reads the sentinel instead of whatever lies before the table.*/
 struct decompression_strtable {
     size_t size;
     size_t max_size; 
 
     strtable_entry *arr;
+    strtable_string *strings; // indexed on the code, like arr
+    int *scratch; // bookkeeping for pruning, one int per code
+
+    arena *arena;
 };
 
 typedef struct decompression_strtable decompression_strtable;
 
 /*Constructs a new compression string table given a max_size.
 The returned string table is dynamically allocated and therefore must be freed.
-The compression string table is implemented as a hash table.*/
+The compression string table is implemented as a hash table. Its memory is reserved for
+max_size codes up front but only backed as it is used, so short inputs never pay for max_size.*/
 compression_strtable *compression_strtable_new(size_t max_size);
 
 /*Inserts a (prefix, character) pair into the table, assigning it the lowest available code.
@@ -60,8 +91,17 @@ void compression_strtable_insert(compression_strtable *table, int prefix, int ch
 The retrieved string table entry is a pointer. If the entry dosen't exist, returns NULL.*/
 strtable_entry *compression_strtable_get(compression_strtable *table, int prefix, int character); 
 
-/*Prunes the string table by removing any table entries that weren't used.*/
-compression_strtable *compression_strtable_prune(compression_strtable *original);
+/*Prefetches the bucket a (prefix, character) pair hashes to, so that a later
+get of the same pair doesn't stall on a cache miss.*/
+void compression_strtable_prefetch(compression_strtable *table, int prefix, int character);
+
+/*Prunes the string table by removing any table entries that weren't used, storing the
+result in pruned, which must have the same max_size. Whatever pruned held before is discarded,
+so two tables can take turns being pruned into each other.*/
+void compression_strtable_prune(compression_strtable *original, compression_strtable *pruned);
+
+/*Removes every entry from the string table, keeping its buckets allocated for reuse.*/
+void compression_strtable_reset(compression_strtable *table);
 
 /*Dumps a human readable version of the string table to the file specified.*/
 void compression_strtable_dump(compression_strtable *table, char *filename);
@@ -69,6 +109,9 @@ void compression_strtable_dump(compression_strtable *table, char *filename);
 /*Frees the memory allocated for a the string table.*/
 void compression_strtable_free(compression_strtable *table);
 
+/*The bytes a compression string table of max_size codes can use at most.*/
+size_t compression_strtable_memory(size_t max_size);
+
 /*Constructs a new string table to be used with decompression given a max_size*/
 decompression_strtable *decompression_strtable_new(size_t max_size);
 
@@ -81,8 +124,12 @@ void decompression_strtable_insert(decompression_strtable *table, int prefix, in
 Returns NULL if the code isn't in the table.*/
 strtable_entry *decompression_strtable_get(decompression_strtable* table, int code);
 
-/*Prunes the string table by removing any table entries that weren't used.*/
-decompression_strtable *decompression_strtable_prune(decompression_strtable *original);
+/*Prunes the string table by removing any table entries that weren't used, storing the
+result in pruned, which must have the same max_size. Whatever pruned held before is discarded.*/
+void decompression_strtable_prune(decompression_strtable *original, decompression_strtable *pruned);
+
+/*Removes every entry from the string table, keeping its array allocated for reuse.*/
+void decompression_strtable_reset(decompression_strtable *table);
 
 /*Dumps a human readable version of the string table to the file specified.*/
 void decompression_strtable_dump(decompression_strtable* table, char* filename);
@@ -90,4 +137,7 @@ void decompression_strtable_dump(decompression_strtable* table, char* filename);
 /*Frees the memory allocated for a the string table.*/
 void decompression_strtable_free(decompression_strtable *table);
 
+/*The bytes a decompression string table of max_size codes can use at most.*/
+size_t decompression_strtable_memory(size_t max_size);
+
 #endif
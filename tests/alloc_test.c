@@ -0,0 +1,108 @@
+/*
+Checks that the codec doesn't allocate once its contexts are set up.
+
+The test is linked with `-Wl,--wrap=...` (see `make alloc_test`), which routes every call
+the codec makes to malloc, calloc, realloc and free through the counters below. Streams
+long enough to fill and prune the string tables many times are then compressed and
+decompressed block by block, and any allocation made while doing so fails the test.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compress.h"
+#include "decompress.h"
+#include "format.h"
+#include "test_input.h"
+
+#define INPUT_SIZE (4 << 20)
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static size_t allocations = 0;
+static size_t frees = 0;
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL)
+        frees++;
+    __real_free(ptr);
+}
+
+/*Compresses and decompresses input block by block, twice with one reset in between.
+Returns the number of allocations made after the contexts were constructed.*/
+size_t run(const unsigned char *input, size_t len, int max_bits, int streams, int flags, unsigned char *decoded) {
+    compress_context *cctx = compress_context_new(max_bits, streams, flags);
+    decompress_context *dctx = decompress_context_new(max_bits, streams, flags);
+    size_t before = allocations + frees;
+
+    for (int pass = 0; pass < 2; pass++) {
+        compress_context_reset(cctx);
+        decompress_context_reset(dctx, max_bits, streams, flags);
+
+        for (size_t offset = 0; offset < len; offset += BLOCK_SIZE) {
+            size_t block_len = len - offset < BLOCK_SIZE ? len - offset : BLOCK_SIZE;
+            binaryio_writer *record = compress_block(cctx, input + offset, block_len);
+
+            block_header header;
+            block_header_unpack(&header, record->data);
+            if (decompress_block(dctx, &header, record->data + BLOCK_HEADER_SIZE, decoded + offset) != 0) {
+                printf("max_bits=%d streams=%d: block at %zu failed to decode\n", max_bits, streams, offset);
+                exit(1);
+            }
+        }
+
+        if (memcmp(input, decoded, len) != 0) {
+            printf("max_bits=%d streams=%d: round trip mismatch\n", max_bits, streams);
+            exit(1);
+        }
+    }
+
+    size_t count = allocations + frees - before;
+    compress_context_free(cctx);
+    decompress_context_free(dctx);
+    return count;
+}
+
+int main() {
+    unsigned char *input = malloc(INPUT_SIZE);
+    unsigned char *decoded = malloc(INPUT_SIZE);
+    test_input_fill(input, INPUT_SIZE);
+
+    int max_bits[] = {9, 12, 16, 20};
+    int streams[] = {1, 3};
+    int flags[] = {0, STREAM_FLAG_ASYNC_PRUNE};
+    int failed = 0;
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 2; j++) {
+            for (int k = 0; k < 2; k++) {
+                size_t count = run(input, INPUT_SIZE, max_bits[i], streams[j], flags[k], decoded);
+                printf("max_bits=%-2d streams=%d flags=%d: %zu allocator calls after setup\n", max_bits[i], streams[j], flags[k], count);
+                failed |= (count != 0);
+            }
+        }
+    }
+
+    free(input);
+    free(decoded);
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
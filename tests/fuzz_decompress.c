@@ -0,0 +1,216 @@
+/*
+Fuzzes the decoders with damaged streams.
+
+Valid streams are compressed from synthetic inputs with a range of settings, then mutated
+by flipping bits, overwriting bytes, cutting, extending and splicing them, and fed to both
+`decompress_buffer` and the `--grep` search. Neither may crash, hang or touch memory it
+doesn't own, and both must return 0 or one of the DECOMPRESS_ERR_* codes. The test is built
+with AddressSanitizer and UBSan (see `make fuzz_test`), which turn any bad access into an
+abort; the arenas poison what they haven't handed out, so the string tables are covered too.
+
+With no arguments, a fixed number of mutants is run from a fixed seed, so a failure is
+reproducible. `fuzz_decompress ITERATIONS SEED` runs any other amount. Built with
+-DLIBFUZZER, the file provides LLVMFuzzerTestOneInput instead of main.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "compress.h"
+#include "decompress.h"
+#include "search.h"
+#include "format.h"
+#include "test_input.h"
+
+#define INPUT_SIZE (3 * BLOCK_SIZE + 1234) // a few blocks, the last one partial
+#define ITERATIONS 20000
+#define ERROR_CODES 7
+
+static uint64_t rng_state;
+
+static uint64_t next_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t outcomes[ERROR_CODES + 1]; // outcomes[-status], 0 for success
+
+/*Searches a whole stream in memory, block by block, the way `search()` does on stdin.*/
+int search_buffer(const unsigned char *in, size_t len) {
+    stream_header s_header;
+    if (len < STREAM_HEADER_SIZE)
+        return DECOMPRESS_ERR_TRUNCATED;
+    int header_status = decompress_read_header(&s_header, in);
+    if (header_status != 0)
+        return header_status;
+
+    search_pattern *pattern = search_pattern_new((const unsigned char *) "the", 3);
+    search_context *ctx = search_context_new(pattern, s_header.max_bits, s_header.streams, s_header.flags);
+    int status = DECOMPRESS_ERR_TRUNCATED;
+
+    size_t offset = STREAM_HEADER_SIZE;
+    while (len - offset >= BLOCK_HEADER_SIZE) {
+        block_header b_header;
+        block_header_unpack(&b_header, in + offset);
+        offset += BLOCK_HEADER_SIZE;
+
+        if (b_header.type == BLOCK_END) {
+            status = 0;
+            break;
+        }
+        if (b_header.payload_size > len - offset)
+            break;
+
+        status = search_block(ctx, &b_header, in + offset);
+        if (status != 0)
+            break;
+        status = DECOMPRESS_ERR_TRUNCATED;
+        binaryio_writer_reset(ctx->out);
+        offset += b_header.payload_size;
+    }
+
+    search_context_free(ctx);
+    search_pattern_free(pattern);
+    return status;
+}
+
+/*Runs both decoders on one stream. Returns 0 if they behaved, or 1.*/
+int fuzz_one(const unsigned char *data, size_t len) {
+    // a private copy of exactly len bytes, so reading past the end is caught
+    unsigned char *in = malloc(len > 0 ? len : 1);
+    memcpy(in, data, len);
+
+    decompress_context *ctx = decompress_context_new(MAX_BITS_LB, 1, 0);
+    binaryio_writer *out = binaryio_writer_new();
+    int status = decompress_buffer(ctx, in, len, out);
+    int search_status = search_buffer(in, len);
+
+    binaryio_writer_free(out);
+    decompress_context_free(ctx);
+    free(in);
+
+    if (status > 0 || status < -ERROR_CODES || search_status > 0 || search_status < -ERROR_CODES) {
+        printf("unexpected status %d (search %d)\n", status, search_status);
+        return 1;
+    }
+    outcomes[-status]++;
+    return 0;
+}
+
+#ifdef LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (fuzz_one(data, size) != 0)
+        abort();
+    return 0;
+}
+#else
+
+/*Damages a copy of a seed stream in one of several ways, storing it in mutant.*/
+size_t mutate(const binaryio_writer *seed, const binaryio_writer *other, unsigned char *mutant) {
+    size_t len = seed->size;
+    memcpy(mutant, seed->data, len);
+
+    int kinds = 1 + next_random() % 4;
+    for (int k = 0; k < kinds; k++) {
+        uint64_t r = next_random();
+        size_t at = (len > 0) ? next_random() % len : 0;
+
+        switch (r % 6) {
+            case 0: // flip a bit
+                if (len > 0)
+                    mutant[at] ^= 1 << (r >> 8) % 8;
+                break;
+            case 1: // overwrite a few bytes
+                for (size_t i = at; i < len && i < at + 1 + (r >> 8) % 8; i++)
+                    mutant[i] = next_random();
+                break;
+            case 2: // cut the stream short
+                len = at;
+                break;
+            case 3: // append garbage
+                for (int i = 0; i < 64; i++)
+                    mutant[len++] = next_random();
+                break;
+            case 4: { // splice in a piece of another stream
+                size_t from = next_random() % other->size;
+                size_t n = 1 + next_random() % 256;
+                for (size_t i = 0; i < n && at + i < len && from + i < other->size; i++)
+                    mutant[at + i] = other->data[from + i];
+                break;
+            }
+            case 5: // overwrite a size field with an extreme value
+                if (len >= 4) {
+                    at = at > len - 4 ? len - 4 : at;
+                    pack_u32((r >> 8) % 2 ? 0xFFFFFFFF : (r >> 16) % (2 * BLOCK_PAYLOAD_MAX), mutant + at);
+                }
+                break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    long iterations = (argc > 1) ? atol(argv[1]) : ITERATIONS;
+    rng_state = (argc > 2) ? strtoull(argv[2], NULL, 10) * 0x9E3779B97F4A7C15ULL + 1 : 0x5DEECE66DULL;
+
+    unsigned char *input = malloc(INPUT_SIZE);
+    test_input_fill(input, INPUT_SIZE);
+
+    // every combination of settings that changes how codes are read and tables are kept
+    int max_bits[] = {9, 12, 16};
+    int streams[] = {1, 3};
+    int flags[] = {0, STREAM_FLAG_ASYNC_PRUNE, STREAM_FLAG_INDEPENDENT};
+    binaryio_writer *seeds[18];
+    int num_seeds = 0;
+    int failed = 0;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            for (int k = 0; k < 3; k++) {
+                compress_context *cctx = compress_context_new(max_bits[i], streams[j], flags[k]);
+                binaryio_writer *seed = binaryio_writer_new();
+                compress_buffer(cctx, input, INPUT_SIZE, seed);
+                compress_context_free(cctx);
+
+                // the seeds themselves must round-trip
+                decompress_context *dctx = decompress_context_new(MAX_BITS_LB, 1, 0);
+                binaryio_writer *out = binaryio_writer_new();
+                if (decompress_buffer(dctx, seed->data, seed->size, out) != 0 || out->size != INPUT_SIZE
+                    || memcmp(out->data, input, INPUT_SIZE) != 0 || search_buffer(seed->data, seed->size) != 0) {
+                    printf("max_bits=%d streams=%d flags=%d: seed doesn't round-trip\n", max_bits[i], streams[j], flags[k]);
+                    failed = 1;
+                }
+                binaryio_writer_free(out);
+                decompress_context_free(dctx);
+
+                seeds[num_seeds++] = seed;
+            }
+        }
+    }
+
+    unsigned char *mutant = malloc(INPUT_SIZE * 2 + 64 * 4);
+    for (long n = 0; n < iterations && !failed; n++) {
+        binaryio_writer *seed = seeds[next_random() % num_seeds];
+        binaryio_writer *other = seeds[next_random() % num_seeds];
+        size_t len = mutate(seed, other, mutant);
+        if (fuzz_one(mutant, len) != 0) {
+            printf("mutant %ld failed\n", n);
+            failed = 1;
+        }
+    }
+
+    printf("%ld mutants: %zu decoded, %zu bad header, %zu bad block, %zu bad code, %zu overrun, %zu truncated, "
+        "%zu bad version, %zu bad flags\n", iterations, outcomes[0], outcomes[1], outcomes[2], outcomes[3], outcomes[4],
+        outcomes[5], outcomes[6], outcomes[7]);
+
+    for (int i = 0; i < num_seeds; i++)
+        binaryio_writer_free(seeds[i]);
+    free(mutant);
+    free(input);
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
+#endif
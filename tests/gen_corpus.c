@@ -0,0 +1,203 @@
+/*
+Generates deterministic synthetic input of any size for benchmarks.
+
+The output is a sequence of segments, each drawn at random from the seed: a literal stretch of
+text or of binary bytes, a copy of earlier output, or a run of one byte. The knobs control how
+compressible the result is and in which way:
+
+    -s SEED      seed of the generator (defaults to 1), the same seed always gives the same bytes
+    -e BITS      entropy of a binary literal byte in bits, 0 to 8 (defaults to 6)
+    -t FRACTION  share of literal segments that are text rather than binary (defaults to 0.5)
+    -p FRACTION  share of segments that copy earlier output (defaults to 0.3)
+    -d DISTANCE  farthest back a copy reaches (defaults to 64K)
+    -r LENGTH    average length of a run of one byte, 0 for no runs, at most 512K (defaults to 64)
+
+SIZE and DISTANCE accept a K, M or G suffix. The output goes to stdout.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define CHUNK (1 << 20) // we write the output in chunks this big
+#define VOCABULARY 4096 // distinct words of text literals
+#define RUN_SHARE 0.02 // share of segments that are runs when runs are on
+
+struct generator {
+    uint64_t state;
+
+    double entropy;
+    double text_share;
+    double copy_share;
+    size_t distance;
+    size_t run_length;
+
+    int alphabet; // binary literal bytes are drawn from this many values
+    char words[VOCABULARY][12];
+
+    unsigned char *ring; // the output, indexed modulo mask + 1, so copies can reach back distance bytes
+    size_t mask;
+    size_t pos; // bytes generated so far
+    size_t flushed; // bytes written so far
+};
+
+typedef struct generator generator;
+
+/*xorshift64*, which is fast and good enough for test data.*/
+static inline uint64_t __next(generator *g) {
+    g->state ^= g->state >> 12;
+    g->state ^= g->state << 25;
+    g->state ^= g->state >> 27;
+    return g->state * 0x2545F4914F6CDD1DULL;
+}
+
+/*A uniform integer in [lo, hi].*/
+static inline size_t __uniform(generator *g, size_t lo, size_t hi) {
+    return lo + __next(g) % (hi - lo + 1);
+}
+
+/*A uniform double in [0, 1).*/
+static inline double __unit(generator *g) {
+    return (__next(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*Writes out the bytes generated since the last flush, up to offset end.*/
+void __flush(generator *g, size_t end) {
+    while (g->flushed < end) {
+        size_t start = g->flushed & g->mask;
+        size_t len = end - g->flushed;
+        if (len > g->mask + 1 - start) // the bytes wrap around the end of the ring
+            len = g->mask + 1 - start;
+        if (fwrite(g->ring + start, 1, len, stdout) != len) {
+            perror("gen_corpus");
+            exit(1);
+        }
+        g->flushed += len;
+    }
+}
+
+static inline void __put(generator *g, unsigned char byte) {
+    g->ring[g->pos++ & g->mask] = byte;
+}
+
+/*Appends words followed by separators until at least len bytes were added. Low word indices
+are picked far more often than high ones, so word frequencies are skewed like in real text.*/
+void __text(generator *g, size_t len) {
+    for (size_t end = g->pos + len; g->pos < end; ) {
+        size_t a = __uniform(g, 0, VOCABULARY - 1), b = __uniform(g, 0, VOCABULARY - 1);
+        const char *word = g->words[a * b / VOCABULARY];
+        for (int i = 0; word[i] != '\0'; i++)
+            __put(g, word[i]);
+
+        uint64_t r = __next(g) % 16;
+        __put(g, r == 0 ? '\n' : r == 1 ? ',' : ' ');
+    }
+}
+
+void __binary(generator *g, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        __put(g, __next(g) % g->alphabet);
+}
+
+void __copy(generator *g, size_t len) {
+    size_t reach = g->pos < g->distance ? g->pos : g->distance;
+    size_t from = g->pos - __uniform(g, 1, reach);
+    for (size_t i = 0; i < len; i++)
+        __put(g, g->ring[(from + i) & g->mask]);
+}
+
+void __run(generator *g, size_t len) {
+    unsigned char byte = __next(g);
+    for (size_t i = 0; i < len; i++)
+        __put(g, byte);
+}
+
+/*Appends one segment.*/
+void __segment(generator *g) {
+    double r = __unit(g);
+
+    if (g->run_length > 0 && r < RUN_SHARE)
+        __run(g, __uniform(g, 1, 2 * g->run_length - 1));
+    else if (g->pos > 0 && r < RUN_SHARE + g->copy_share)
+        __copy(g, __uniform(g, 8, 128));
+    else if (__unit(g) < g->text_share)
+        __text(g, __uniform(g, 16, 256));
+    else
+        __binary(g, __uniform(g, 16, 256));
+}
+
+/*Parses a size with an optional K, M or G suffix. Returns 0 if it isn't one.*/
+size_t __parse_size(const char *s) {
+    char *end;
+    double value = strtod(s, &end);
+    if (*end == 'K' || *end == 'k')
+        value *= 1 << 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        value *= 1 << 20, end++;
+    else if (*end == 'G' || *end == 'g')
+        value *= 1 << 30, end++;
+    return (*end != '\0' || value < 0) ? 0 : (size_t) value;
+}
+
+int main(int argc, char **argv) {
+    generator *g = calloc(1, sizeof(generator));
+    uint64_t seed = 1;
+    g->entropy = 6;
+    g->text_share = 0.5;
+    g->copy_share = 0.3;
+    g->distance = 1 << 16;
+    g->run_length = 64;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:e:t:p:d:r:")) != -1) {
+        switch (c) {
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'e': g->entropy = atof(optarg); break;
+            case 't': g->text_share = atof(optarg); break;
+            case 'p': g->copy_share = atof(optarg); break;
+            case 'd': g->distance = __parse_size(optarg); break;
+            case 'r': g->run_length = atol(optarg); break;
+            default: goto usage;
+        }
+    }
+
+    size_t size = (optind == argc - 1) ? __parse_size(argv[optind]) : 0;
+    if (size == 0 || g->entropy < 0 || g->entropy > 8 || g->text_share < 0 || g->text_share > 1
+        || g->copy_share < 0 || g->copy_share + RUN_SHARE > 1 || g->distance == 0 || g->run_length > CHUNK / 2)
+        goto usage;
+
+    // the state must never be 0, so we mix the seed up first
+    g->state = (seed + 1) * 0x9E3779B97F4A7C15ULL;
+    g->alphabet = (int) (pow(2, g->entropy) + 0.5);
+
+    for (int w = 0; w < VOCABULARY; w++) {
+        size_t len = __uniform(g, 2, 10);
+        for (size_t i = 0; i < len; i++)
+            g->words[w][i] = 'a' + __next(g) % 26;
+    }
+
+    // the ring holds the unwritten bytes, less than two chunks, on top of the farthest reach of a copy
+    size_t ring_size = 1;
+    while (ring_size < g->distance + 2 * CHUNK)
+        ring_size <<= 1;
+    g->ring = malloc(ring_size);
+    g->mask = ring_size - 1;
+
+    // a segment is shorter than a chunk, so flushing between segments never overwrites unwritten bytes
+    while (g->pos < size) {
+        __segment(g);
+        if (g->pos - g->flushed >= CHUNK)
+            __flush(g, g->pos < size ? g->pos : size);
+    }
+    __flush(g, size);
+
+    free(g->ring);
+    free(g);
+    return 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-s SEED] [-e BITS] [-t FRACTION] [-p FRACTION] [-d DISTANCE] [-r LENGTH] SIZE\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,107 @@
+#!/bin/bash
+
+# Load test for the resource limits of compress.
+# Checks how closely --max-rate and --cpu-share are held, that --max-memory holds with and
+# without huge pages, and how much a compression running next to compressd slows its requests
+# down with and without --cpu-share.
+# Run from the root of the repository.
+
+# ARGUMENT PARSING
+mbits=20
+size_mb=16
+
+while getopts m:s: flag
+do
+    case "$flag" in
+        m) mbits=${OPTARG};;
+        s) size_mb=${OPTARG};;
+    esac
+done
+
+echo -e "Building binaries...\n"
+make
+
+workdir=$(mktemp -d)
+trap 'kill $(jobs -p) 2> /dev/null; rm -rf "$workdir"' EXIT
+
+# The input is the test corpus repeated until it is size_mb MiB long.
+while [ $(stat -c %s "$workdir/input" 2> /dev/null || echo 0) -lt $((size_mb * 1048576)) ]; do
+    cat tests/test_cases/* >> "$workdir/input"
+done
+truncate -s $((size_mb * 1048576)) "$workdir/input"
+
+TIMEFORMAT="%R %U %S"
+
+# Runs compress with the given options and prints the wall time, user time and system time.
+timed_compress() {
+    { time ./compress -m $mbits "$@" < "$workdir/input" > "$workdir/output" 2> /dev/null; } 2>&1
+}
+
+echo -e "\nThroughput limit (-m $mbits, $size_mb MiB input)"
+read wall user sys < <(timed_compress)
+echo "unlimited: $(awk "BEGIN { printf \"%.2f\", $size_mb / $wall }") MiB/s"
+for rate in 1 2 4; do
+    read wall user sys < <(timed_compress --max-rate $rate)
+    echo "--max-rate $rate: $(awk "BEGIN { printf \"%.2f\", $size_mb / $wall }") MiB/s"
+done
+
+echo -e "\nCPU share limit"
+for share in 0.25 0.5; do
+    read wall user sys < <(timed_compress --cpu-share $share)
+    echo "--cpu-share $share: $(awk "BEGIN { printf \"%.2f\", ($user + $sys) / $wall }") of a CPU"
+done
+
+echo -e "\nMemory limit"
+# Prints the peak RSS in MiB of compress, sampled every 0.05 s, while it compresses the given
+# file with the given options.
+peak_rss() {
+    local input=$1
+    shift
+    ./compress -m $mbits "$@" < "$input" > "$workdir/output" 2> /dev/null &
+    local pid=$! peak=0 rss
+    while kill -0 $pid 2> /dev/null; do
+        rss=$(awk '/^VmHWM/ { print $2 }' /proc/$pid/status 2> /dev/null)
+        [ -n "$rss" ] && peak=$rss
+        sleep 0.05
+    done
+    wait $pid
+    awk "BEGIN { printf \"%.1f\", $peak / 1024 }"
+}
+
+# --max-memory covers the string tables and buffers, so the program itself comes on top: we
+# take that to be what compressing a single byte with the smallest tables takes up.
+head -c 1 "$workdir/input" > "$workdir/byte"
+base=$(mbits=9 peak_rss "$workdir/byte")
+echo "program alone: $base MiB"
+for pages in 0 1 hugetlb; do
+    for limit in 8 16 32; do
+        rss=$(LZW_HUGE_PAGES=$pages peak_rss "$workdir/input" --max-memory $limit)
+        verdict=$(awk "BEGIN { print ($rss <= $base + $limit) ? \"within\" : \"OVER\" }")
+        echo "LZW_HUGE_PAGES=$pages --max-memory $limit: $rss MiB, $verdict the limit"
+    done
+done
+
+echo -e "\nNeighbor latency (compressd, 1 connection, 4 KiB requests)"
+socket="$workdir/compressd.sock"
+./compressd -w 1 "$socket" &
+while [ ! -S "$socket" ]; do sleep 0.1; done
+
+# Prints the load generator's summary while compress runs with the given options, if any.
+neighbor() {
+    if [ "$1" != "none" ]; then
+        while true; do ./compress -m $mbits "$@" < "$workdir/input" > /dev/null 2> /dev/null; done &
+        local loop=$!
+        sleep 0.5
+    fi
+    ./compressload -S "$socket" -r 2000 -s 4096 tests/test_cases/alice29.txt | grep -E "throughput|latency" | paste -s -d ' '
+    if [ "$1" != "none" ]; then
+        kill $loop
+        wait $loop 2> /dev/null
+        pkill -f "compress -m $mbits" 2> /dev/null
+    fi
+}
+
+echo -n "alone:                    "; neighbor none
+echo -n "next to compress:         "; neighbor
+echo -n "next to --cpu-share 0.25: "; neighbor --cpu-share 0.25
+echo -n "next to --max-rate 1:     "; neighbor --max-rate 1
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# Streaming benchmark for compress and decompress on large synthetic inputs.
+# Pipes SIZE bytes from tests/gen_corpus through compress and decompress without touching
+# the disk, sampling the throughput and RSS of both processes every INTERVAL seconds, and
+# checks that the output matches the input. Throughput that falls or RSS that keeps growing
+# as the stream goes on shows up in the samples and in the summary.
+# Run from the root of the repository.
+#
+#   ./tests/stream_bench.sh [-m MAXBITS] [-s SIZE] [-i INTERVAL] [-g "GEN_CORPUS OPTIONS"] [-c "COMPRESS OPTIONS"]
+
+# ARGUMENT PARSING
+mbits=20
+size=1G
+interval=5
+gen_options=""
+compress_options=""
+
+while getopts m:s:i:g:c: flag
+do
+    case "$flag" in
+        m) mbits=${OPTARG};;
+        s) size=${OPTARG};;
+        i) interval=${OPTARG};;
+        g) gen_options=${OPTARG};;
+        c) compress_options=${OPTARG};;
+    esac
+done
+
+echo -e "Building binaries...\n"
+make && make tests/gen_corpus || exit 1
+
+workdir=$(mktemp -d)
+trap 'kill $(jobs -p) 2> /dev/null; rm -rf "$workdir"' EXIT
+
+# Prints a field of /proc/PID/status or /proc/PID/io, or 0 once the process is gone.
+proc_field() {
+    awk -v key="$3:" '$1 == key { print $2; found = 1 } END { if (!found) print 0 }' "/proc/$1/$2" 2> /dev/null || echo 0
+}
+
+# the input is generated twice, once to compress and once to check the output against
+mkfifo "$workdir/raw" "$workdir/packed" "$workdir/unpacked"
+./tests/gen_corpus $gen_options $size | cksum > "$workdir/input.sum" &
+cksum < "$workdir/unpacked" > "$workdir/output.sum" &
+./tests/gen_corpus $gen_options $size > "$workdir/raw" &
+./compress -m $mbits $compress_options < "$workdir/raw" > "$workdir/packed" &
+compress_pid=$!
+./decompress < "$workdir/packed" > "$workdir/unpacked" &
+decompress_pid=$!
+
+echo -e "\nStreaming $size through compress -m $mbits $compress_options (gen_corpus ${gen_options:-defaults})\n"
+printf "%8s %10s %14s %16s %14s %16s\n" "time s" "in MiB" "compress MiB/s" "compress RSS MiB" "decomp. MiB/s" "decomp. RSS MiB"
+
+start=$(date +%s.%N)
+last_time=$start
+last_in=0
+last_out=0
+while true; do
+    sleep $interval
+    kill -0 $compress_pid 2> /dev/null || break
+    now=$(date +%s.%N)
+    # rchar of compress is the input it has consumed, wchar of decompress the output it has produced
+    in=$(proc_field $compress_pid io rchar)
+    out=$(proc_field $decompress_pid io wchar)
+    compress_rss=$(proc_field $compress_pid status VmRSS)
+    decompress_rss=$(proc_field $decompress_pid status VmRSS)
+
+    awk -v t=$(awk "BEGIN { print $now - $start }") -v dt=$(awk "BEGIN { print $now - $last_time }") \
+        -v in_=$in -v din=$((in - last_in)) -v dout=$((out - last_out)) -v crss=$compress_rss -v drss=$decompress_rss \
+        'BEGIN { printf "%8.1f %10.0f %14.2f %16.1f %14.2f %16.1f\n", t, in_ / 1048576, din / dt / 1048576, crss / 1024, dout / dt / 1048576, drss / 1024 }' \
+        | tee -a "$workdir/samples"
+
+    last_time=$now
+    last_in=$in
+    last_out=$out
+done
+wait
+
+# The summary compares the second and the last quarter of the samples, leaving out the first,
+# in which the string tables are still filling up.
+echo
+awk '{ rate[NR] = $3; rss[NR] = $4; drss[NR] = $6; if ($4 > peak) peak = $4; if ($6 > dpeak) dpeak = $6 }
+    END {
+        q = int(NR / 4); if (q < 1) { print "too few samples for a summary, lower -i"; exit }
+        for (i = q + 1; i <= 2 * q; i++) early += rate[i]
+        for (i = NR - q + 1; i <= NR; i++) late += rate[i]
+        printf "compress throughput, last vs second quarter: %+.1f%%\n", (late / early - 1) * 100
+        printf "compress RSS: %.1f MiB after the first quarter, %.1f MiB peak\n", rss[q + 1], peak
+        printf "decompress RSS: %.1f MiB after the first quarter, %.1f MiB peak\n", drss[q + 1], dpeak
+    }' "$workdir/samples"
+total=$(awk "BEGIN { print $(date +%s.%N) - $start }")
+echo "overall: $(awk "BEGIN { printf \"%.2f\", $(cut -d ' ' -f 2 "$workdir/input.sum") / 1048576 / $total }") MiB/s"
+
+if cmp -s "$workdir/input.sum" "$workdir/output.sum"; then
+    echo "round trip: OK"
+else
+    echo "round trip: MISMATCH"
+    exit 1
+fi
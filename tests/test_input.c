@@ -0,0 +1,30 @@
+#include "test_input.h"
+#include "format.h"
+
+void test_input_fill(unsigned char *buf, size_t len) {
+    static const char *words[] = {
+        "the ", "of ", "compress", "table ", "string ", "and ", "<div class=\"", "\">", "\n",
+        "http://www.", ".com/", "prune ", "code ", "1024 ", "LZW ", "block ", "stream ", "e"
+    };
+    unsigned int seed = 12345;
+    size_t pos = 0;
+
+    while (pos < len) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = seed >> 16;
+
+        if ((pos / BLOCK_SIZE) % 4 == 2) { // noise, stored as is
+            buf[pos++] = r >> 3;
+        }
+        else if (r % 97 == 0) { // a run
+            size_t run = 32 + r % 300;
+            for (size_t i = 0; i < run && pos < len; i++)
+                buf[pos++] = 'a' + r % 3;
+        }
+        else {
+            const char *word = words[r % (sizeof(words) / sizeof(words[0]))];
+            for (size_t i = 0; word[i] != '\0' && pos < len; i++)
+                buf[pos++] = word[i];
+        }
+    }
+}
@@ -0,0 +1,17 @@
+/*
+Synthetic input shared by the C tests.
+
+The input mixes text made of a few repeated words, runs of a single byte and noise, so that
+compressing it gives LZW blocks, run tokens and stored blocks. It only depends on its length.
+*/
+#ifndef TEST_INPUT
+#define TEST_INPUT
+#include <stddef.h>
+
+/*
+Fills buf with len bytes of test input. The third of every four BLOCK_SIZE blocks is noise,
+so any input longer than two blocks has a stored block.
+*/
+void test_input_fill(unsigned char *buf, size_t len);
+
+#endif
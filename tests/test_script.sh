@@ -5,13 +5,15 @@
 dbg=false
 mbits=12
 break_on_error=false
+features_only=false
 
-while getopts dm:b flag
+while getopts dm:bf flag
 do 
     case "$flag" in
         d) dbg=true;;
         m) mbits=${OPTARG};;
         b) break_on_error=true;;
+        f) features_only=true;;
     esac
 done
 
@@ -22,6 +24,31 @@ fi
 echo -e "Building binaries...\n"
 make
 
+feature_count=0
+feature_correct=0
+
+# Records the outcome of one feature test: report NAME STATUS, where a STATUS of 0 is a success.
+report() {
+    feature_count=$((feature_count + 1))
+    if [ "$2" -eq 0 ]; then
+        echo -e "\033[1m$1\033[0m: \033[1;32mSuccess\033[0m"
+        feature_correct=$((feature_correct + 1))
+    else
+        echo -e "\033[1m$1\033[0m: \033[1;31mFailure\033[0m"
+    fi
+}
+
+# Compresses a file with the given options and checks that it decompresses to the original:
+# round_trip FILE [OPTIONS...]. The compressed stream is left in temp.FEATURE.COMPRESS.
+round_trip() {
+    local filename=$1
+    shift
+    ./compress "$@" < "$filename" > "temp.FEATURE.COMPRESS" \
+        && ./decompress < "temp.FEATURE.COMPRESS" > "temp.FEATURE.OUT" \
+        && cmp -s "temp.FEATURE.OUT" "$filename"
+}
+
+if [ "$features_only" = false ]; then
 echo -e "\nRunning LZW Unit Tests..."
 
 file_count=0
@@ -94,8 +121,155 @@ for filename in tests/test_cases/*; do
         fi
     fi
 done
-echo -e "\033[1mAGGREGATE RESULTS\033[0m"
+fi
+
+echo -e "\nRunning Feature Tests...\n"
+
+# Runs just under, at and above the shortest run token, and longer than the longest one.
+for run_length in 31 32 65567 65568 200000; do
+    perl -e "print 'header' . ('r' x $run_length) . 'trailer'" > "temp.FEATURE.IN"
+    round_trip "temp.FEATURE.IN" -m $mbits
+    report "Run of $run_length bytes" $?
+done
+# a long run must be coded as run tokens rather than as ever longer strings
+perl -e "print 'x' x 1000000" > "temp.FEATURE.IN"
+round_trip "temp.FEATURE.IN" -m $mbits && [ $(wc -c < "temp.FEATURE.COMPRESS") -lt 1000 ]
+report "Run of 1000000 bytes compresses to run tokens" $?
+
+# every number of streams, with table sizes that do and don't get pruned
+cat tests/test_cases/alice29.txt tests/test_cases/kppkn.gtb > "temp.FEATURE.IN"
+for m in 9 12 16; do
+    for n in 1 2 3 4 5 6 7 8; do
+        round_trip "temp.FEATURE.IN" -m $m -n $n
+        report "Round trip with -m $m -n $n" $?
+    done
+done
+
+# the stream header must carry the magic bytes and version, and decompress must say which one is wrong
+./compress -m $mbits < tests/test_cases/alice29.txt > "temp.FEATURE.COMPRESS"
+[ "$(head -c 3 "temp.FEATURE.COMPRESS" | od -An -tx1 | tr -d ' ')" = "4c5a01" ]
+report "Stream header starts with the magic bytes and version" $?
+while read offset byte message; do
+    cp "temp.FEATURE.COMPRESS" "temp.FEATURE.DAMAGED"
+    printf "\\x$byte" | dd of="temp.FEATURE.DAMAGED" bs=1 seek=$offset conv=notrunc 2> /dev/null
+    ./decompress < "temp.FEATURE.DAMAGED" 2> "temp.FEATURE.ERR" > /dev/null
+    [ $? -ne 0 ] && grep -q "$message" "temp.FEATURE.ERR"
+    report "decompress rejects byte $offset of the header set to 0x$byte" $?
+done << EOF
+0 00 invalid stream header
+2 02 unsupported format version
+4 80 unknown stream flags
+EOF
+
+# --verify passes good streams, and the normal build has no fault hook to damage them
+LZW_CORRUPT_BLOCK=1 round_trip "temp.FEATURE.IN" -m $mbits --verify
+report "--verify accepts a good stream" $?
+
+# a byte damaged in the middle of the output, in an LZW block and in a stored block, must not
+# decompress to the original
+for filename in "temp.FEATURE.IN" tests/test_cases/fireworks.jpeg; do
+    ./compress -m $mbits --verify < "$filename" > "temp.FEATURE.COMPRESS"
+    middle=$(($(wc -c < "temp.FEATURE.COMPRESS") / 2))
+    byte=$(od -An -tu1 -j $middle -N 1 "temp.FEATURE.COMPRESS")
+    printf "\\x$(printf %02x $((byte ^ 0xff)))" | dd of="temp.FEATURE.COMPRESS" bs=1 seek=$middle conv=notrunc 2> /dev/null
+    ./decompress < "temp.FEATURE.COMPRESS" 2> /dev/null | cmp -s - "$filename"
+    [ $? -ne 0 ]
+    report "A damaged payload byte of $(basename "$filename") doesn't round-trip" $?
+done
+
+# tests/fault/compress damages block 1 after coding it, as a bug in the encoder would
+make -s tests/fault/compress
+for filename in "temp.FEATURE.IN" tests/test_cases/fireworks.jpeg; do
+    LZW_CORRUPT_BLOCK=1 ./tests/fault/compress -m $mbits --verify < "$filename" > "temp.FEATURE.COMPRESS" 2> /dev/null
+    verify_status=$?
+    ./decompress < "temp.FEATURE.COMPRESS" > /dev/null 2>&1
+    [ $verify_status -ne 0 ] && [ $? -ne 0 ]
+    report "--verify rejects a damaged block of $(basename "$filename")" $?
+done
+
+# --grep must find what grep finds. The patterns can't overlap themselves, so grep, which
+# doesn't report overlapping matches, finds all of them. The second input has a match across the
+# first block boundary and one that starts inside a run token.
+{ head -c 65533 tests/test_cases/alice29.txt; printf "needle"; perl -e "print 'x' x 100"; printf "y"; cat tests/test_cases/alice29.txt; } > "temp.FEATURE.GREP"
+for filename in "temp.FEATURE.IN" "temp.FEATURE.GREP"; do
+    for pattern in "the" "Alice" "needle" "xxy" "q"; do
+        for options in "-m 9" "-m 12" "-m 16 -n 3"; do
+            grep -boa -- "$pattern" "$filename" | cut -d: -f1 > "temp.FEATURE.EXPECTED"
+            ./compress $options < "$filename" > "temp.FEATURE.COMPRESS"
+            ./decompress --grep "$pattern" < "temp.FEATURE.COMPRESS" > "temp.FEATURE.OUT"
+            cmp -s "temp.FEATURE.OUT" "temp.FEATURE.EXPECTED"
+            report "--grep \"$pattern\" in $filename with $options" $?
+        done
+    done
+done
+
+# tables only get pruned above MAXBITS 10, and at these sizes they fill up many times over. The
+# codes after a background prune differ from a synchronous one, so the streams must differ too.
+for m in 11 12; do
+    for n in 1 2; do
+        ./compress -m $m -n $n < "temp.FEATURE.IN" > "temp.FEATURE.SYNC"
+        round_trip "temp.FEATURE.IN" -m $m -n $n --async-prune \
+            && ! cmp -s <(tail -c +4 "temp.FEATURE.SYNC") <(tail -c +4 "temp.FEATURE.COMPRESS")
+        report "Round trip with --async-prune -m $m -n $n" $?
+    done
+done
+./compress -m 11 --async-prune --verify < "temp.FEATURE.IN" > /dev/null
+report "--async-prune with --verify" $?
+
+# independent blocks, alone and with other options
+for options in "-m 12" "-m 16 -n 3" "-m 12 --async-prune"; do
+    round_trip "temp.FEATURE.IN" $options --independent
+    report "Round trip with --independent $options" $?
+done
+
+# Compresses a file through the cache and checks the round trip and that the output is the same
+# as without the cache: cached_round_trip FILE [OPTIONS...]. The cache report is left in temp.FEATURE.REPORT.
+cached_round_trip() {
+    local filename=$1
+    shift
+    ./compress --independent < "$filename" > "temp.FEATURE.EXPECTED" \
+        && round_trip "$filename" --cache "temp.FEATURE.CACHE" "$@" 2> "temp.FEATURE.REPORT" \
+        && cmp -s "temp.FEATURE.COMPRESS" "temp.FEATURE.EXPECTED"
+}
+
+rm -rf "temp.FEATURE.CACHE"
+cached_round_trip tests/test_cases/alice29.txt && grep -q "cache hits 0 of 3 blocks" "temp.FEATURE.REPORT"
+report "--cache misses on an empty cache" $?
+cached_round_trip tests/test_cases/alice29.txt && grep -q "cache hits 3 of 3 blocks" "temp.FEATURE.REPORT"
+report "--cache hits on the same input" $?
+
+# a damaged entry must be recomputed instead of used
+entry=$(ls "temp.FEATURE.CACHE"/*.blk | head -1)
+printf '\xff' | dd of="$entry" bs=1 seek=100 conv=notrunc 2> /dev/null
+cached_round_trip tests/test_cases/alice29.txt && grep -q "cache hits 2 of 3 blocks" "temp.FEATURE.REPORT"
+report "--cache ignores a damaged entry" $?
+
+# The cap holds the entries of alice29.txt (70 KB) and asyoulik.txt (61 KB) but not those of
+# kppkn.gtb (45 KB) as well. alice29.txt was written first but used last, so asyoulik.txt is evicted.
+rm -rf "temp.FEATURE.CACHE"
+for filename in alice29.txt asyoulik.txt alice29.txt kppkn.gtb; do
+    cached_round_trip tests/test_cases/$filename --cache-size 0.14 || break
+done
+cached_round_trip tests/test_cases/alice29.txt --cache-size 0.14 && grep -q "cache hits 3 of 3 blocks" "temp.FEATURE.REPORT" \
+    && cached_round_trip tests/test_cases/asyoulik.txt --cache-size 0.14 && grep -q "cache hits 0 of 2 blocks" "temp.FEATURE.REPORT"
+report "--cache evicts the least recently used entries" $?
+
+# the blocks of a JPEG are stored, which is faster than looking them up, so none are cached
+rm -rf "temp.FEATURE.CACHE"
+cached_round_trip tests/test_cases/fireworks.jpeg && [ -z "$(ls -A "temp.FEATURE.CACHE")" ] \
+    && grep -q "cache hits 0 of 0 blocks" "temp.FEATURE.REPORT"
+report "--cache leaves out stored blocks" $?
+
+rm -rf "temp.FEATURE.CACHE"
+rm -f temp.FEATURE.*
+
+echo -e "\n\033[1mAGGREGATE RESULTS\033[0m"
 echo -e "====================================="
+echo -e "\033[1mFeature Tests\033[0m: $feature_correct of $feature_count passed"
+if [ "$features_only" = false ]; then
 echo -e "\033[1mAccuracy\033[0m: $(echo "scale=4; $num_correct / $file_count * 100" | bc -q)%"
 echo -e "\033[1mAverage Compression Increase\033[0m: $(echo "scale=4; $total_compression_increase / $file_count * 100" | bc -q)%"
 echo -e "\033[1mAverage Time Increase\033[0m: $(echo "scale=4; $total_time_increase / $file_count * 100" | bc -q)%"
+fi
+
+[ "$feature_correct" -eq "$feature_count" ]
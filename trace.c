@@ -0,0 +1,129 @@
+#include "trace.h"
+
+#ifdef LZW_TRACE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct trace_event {
+    const char *name; // always a string literal, so only the pointer is kept
+    uint64_t start; // nanoseconds
+    uint64_t duration; // nanoseconds, 0 for instant events
+    int64_t value;
+    int instant;
+};
+
+typedef struct trace_event trace_event;
+
+/*Ring buffer of the events recorded by one thread.*/
+struct trace_ring {
+    trace_event events[TRACE_RING_EVENTS];
+    uint64_t count; // events ever recorded; the latest TRACE_RING_EVENTS are kept
+    int tid;
+    struct trace_ring *next; // every ring is kept in a list so the exit handler can find it
+};
+
+typedef struct trace_ring trace_ring;
+
+int trace_enabled = 0;
+
+static const char *trace_path;
+static const char *trace_process_name;
+static uint64_t trace_epoch;
+
+static __thread trace_ring *thread_ring;
+static trace_ring *rings;
+static int ring_count;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*Returns the calling thread's ring, creating it on the thread's first event.*/
+trace_ring *__trace_thread_ring() {
+    if (thread_ring == NULL) {
+        trace_ring *ring = calloc(1, sizeof(trace_ring));
+
+        pthread_mutex_lock(&rings_lock);
+        ring->tid = ++ring_count;
+        ring->next = rings;
+        rings = ring;
+        pthread_mutex_unlock(&rings_lock);
+
+        thread_ring = ring;
+    }
+    return thread_ring;
+}
+
+void __trace_record(const char *name, uint64_t start, uint64_t duration, int64_t value, int instant) {
+    trace_ring *ring = __trace_thread_ring();
+    trace_event *event = &ring->events[ring->count++ % TRACE_RING_EVENTS];
+
+    event->name = name;
+    event->start = start;
+    event->duration = duration;
+    event->value = value;
+    event->instant = instant;
+}
+
+void trace_record_span(const char *name, uint64_t start, int64_t value) {
+    __trace_record(name, start, trace_now() - start, value, 0);
+}
+
+void trace_record_instant(const char *name, int64_t value) {
+    __trace_record(name, trace_now(), 0, value, 1);
+}
+
+/*Writes every thread's ring to the trace file. Runs at exit.*/
+void __trace_write() {
+    FILE *file = fopen(trace_path, "w");
+    if (file == NULL) {
+        perror("trace");
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"%s\"}}",
+        trace_process_name);
+
+    pthread_mutex_lock(&rings_lock);
+    for (trace_ring *ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t first = (ring->count > TRACE_RING_EVENTS) ? ring->count - TRACE_RING_EVENTS : 0;
+
+        for (uint64_t i = first; i < ring->count; i++) {
+            trace_event *event = &ring->events[i % TRACE_RING_EVENTS];
+            double ts = (event->start - trace_epoch) / 1000.0; // the format counts in microseconds
+
+            if (event->instant)
+                fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f", event->name, ts);
+            else
+                fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f",
+                    event->name, ts, event->duration / 1000.0);
+            fprintf(file, ", \"pid\": 1, \"tid\": %d, \"args\": {\"value\": %lld}}", ring->tid, (long long) event->value);
+        }
+
+        if (first > 0)
+            fprintf(stderr, "trace: thread %d dropped its %llu oldest events\n", ring->tid, (unsigned long long) first);
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
+
+void trace_init(const char *process_name) {
+    trace_path = getenv("LZW_TRACE");
+    if (trace_path == NULL || trace_path[0] == '\0')
+        return;
+
+    trace_process_name = process_name;
+    trace_epoch = trace_now();
+    trace_enabled = 1;
+    atexit(__trace_write);
+}
+
+#endif
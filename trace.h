@@ -0,0 +1,54 @@
+/*
+Timeline tracing of the codec, written in the Chrome trace event format (loads in Perfetto
+or chrome://tracing).
+
+Tracing is compiled in only when LZW_TRACE is defined (`make TRACE=1`); otherwise every
+macro below expands to nothing. A traced binary records events only when the LZW_TRACE
+environment variable names an output file, so with the variable unset the cost is one
+predictable branch per trace point.
+
+Events go to a fixed-size ring buffer owned by the recording thread, so recording never
+takes a lock; when a buffer wraps, its oldest events are dropped. All buffers are written
+out as one JSON file when the process exits.
+*/
+#ifndef TRACE
+#define TRACE
+#include <stdint.h>
+
+#ifdef LZW_TRACE
+
+#define TRACE_RING_EVENTS (1 << 16) // Events kept per thread.
+
+// Whether events are being recorded. Only set by trace_init.
+extern int trace_enabled;
+
+/*
+Enables tracing if the LZW_TRACE environment variable is set, and arranges for the
+trace to be written to the file it names at exit. `process_name` labels the trace.
+*/
+void trace_init(const char *process_name);
+
+// Returns the current time in nanoseconds.
+uint64_t trace_now();
+
+// Records a span called name that started at start (from trace_now) and ends now.
+void trace_record_span(const char *name, uint64_t start, int64_t value);
+
+// Records an instantaneous event called name, carrying value.
+void trace_record_instant(const char *name, int64_t value);
+
+#define TRACE_INIT(process_name) trace_init(process_name)
+#define TRACE_SPAN_BEGIN(var) uint64_t var = trace_enabled ? trace_now() : 0
+#define TRACE_SPAN_END(var, name, value) do { if (trace_enabled) trace_record_span(name, var, value); } while (0)
+#define TRACE_INSTANT(name, value) do { if (trace_enabled) trace_record_instant(name, value); } while (0)
+
+#else
+
+#define TRACE_INIT(process_name) ((void) 0)
+#define TRACE_SPAN_BEGIN(var) ((void) 0)
+#define TRACE_SPAN_END(var, name, value) ((void) 0)
+#define TRACE_INSTANT(name, value) ((void) 0)
+
+#endif
+
+#endif
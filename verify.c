@@ -0,0 +1,130 @@
+#include "verify.h"
+#include "format.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*Decodes one queued block and checks it against the input it was made from.
+Returns 0 if it round-trips.*/
+int __verify_slot(verifier *v, verify_slot *slot) {
+    block_header header;
+    if (slot->record_size < BLOCK_HEADER_SIZE)
+        return -1;
+    block_header_unpack(&header, slot->record);
+
+    if (header.raw_size != slot->raw_size || header.payload_size != slot->record_size - BLOCK_HEADER_SIZE)
+        return -1;
+    if (decompress_block(v->ctx, &header, slot->record + BLOCK_HEADER_SIZE, v->decoded) != 0)
+        return -1;
+
+    return memcmp(v->decoded, slot->raw, slot->raw_size) == 0 ? 0 : -1;
+}
+
+void *__verifier_main(void *arg) {
+    verifier *v = arg;
+
+    pthread_mutex_lock(&v->lock);
+    while (1) {
+        while (v->count == 0 && !v->done)
+            pthread_cond_wait(&v->changed, &v->lock);
+        if (v->count == 0) // done and drained
+            break;
+
+        // the slot stays queued while we work on it, so the encoder can't overwrite it
+        verify_slot *slot = &v->slots[v->head];
+        pthread_mutex_unlock(&v->lock);
+        int result = __verify_slot(v, slot);
+        pthread_mutex_lock(&v->lock);
+
+        if (result != 0 && !v->failed) {
+            v->failed = 1;
+            v->failed_offset = v->verified_bytes;
+        }
+        v->verified_bytes += slot->raw_size;
+        v->head = (v->head + 1) % VERIFY_QUEUE_SLOTS;
+        v->count--;
+        pthread_cond_broadcast(&v->changed);
+
+        // after a failure there is nothing left worth checking
+        if (v->failed)
+            break;
+    }
+    pthread_mutex_unlock(&v->lock);
+
+    return NULL;
+}
+
+verifier *verifier_new(int max_bits, int streams, int flags) {
+    verifier *v = calloc(1, sizeof(verifier));
+    v->ctx = decompress_context_new(max_bits, streams, flags);
+    v->decoded = malloc(BLOCK_SIZE);
+
+    for (int i = 0; i < VERIFY_QUEUE_SLOTS; i++) {
+        v->slots[i].raw = malloc(BLOCK_SIZE);
+        v->slots[i].record = malloc(BLOCK_HEADER_SIZE + BLOCK_PAYLOAD_MAX);
+    }
+
+    pthread_mutex_init(&v->lock, NULL);
+    pthread_cond_init(&v->changed, NULL);
+    pthread_create(&v->thread, NULL, __verifier_main, v);
+
+    return v;
+}
+
+int verifier_submit(verifier *v, const unsigned char *raw, size_t raw_size, const unsigned char *record, size_t record_size) {
+    if (raw_size > BLOCK_SIZE || record_size > BLOCK_HEADER_SIZE + BLOCK_PAYLOAD_MAX)
+        return -1;
+
+    pthread_mutex_lock(&v->lock);
+    while (v->count == VERIFY_QUEUE_SLOTS && !v->failed)
+        pthread_cond_wait(&v->changed, &v->lock);
+
+    if (v->failed) {
+        pthread_mutex_unlock(&v->lock);
+        return -1;
+    }
+    verify_slot *slot = &v->slots[(v->head + v->count) % VERIFY_QUEUE_SLOTS];
+    pthread_mutex_unlock(&v->lock);
+
+    // the verifier never touches slots past head + count, so we fill this one unlocked
+    memcpy(slot->raw, raw, raw_size);
+    slot->raw_size = raw_size;
+    memcpy(slot->record, record, record_size);
+    slot->record_size = record_size;
+
+    pthread_mutex_lock(&v->lock);
+    v->count++;
+    pthread_cond_broadcast(&v->changed);
+    pthread_mutex_unlock(&v->lock);
+
+    return 0;
+}
+
+int verifier_finish(verifier *v) {
+    pthread_mutex_lock(&v->lock);
+    v->done = 1;
+    pthread_cond_broadcast(&v->changed);
+    pthread_mutex_unlock(&v->lock);
+
+    pthread_join(v->thread, NULL);
+    return v->failed ? -1 : 0;
+}
+
+void verifier_free(verifier *v) {
+    for (int i = 0; i < VERIFY_QUEUE_SLOTS; i++) {
+        free(v->slots[i].raw);
+        free(v->slots[i].record);
+    }
+    pthread_mutex_destroy(&v->lock);
+    pthread_cond_destroy(&v->changed);
+    decompress_context_free(v->ctx);
+    free(v->decoded);
+    free(v);
+}
+
+size_t verifier_memory(int max_bits, int streams) {
+    size_t slots = VERIFY_QUEUE_SLOTS * (BLOCK_SIZE + BLOCK_HEADER_SIZE + BLOCK_PAYLOAD_MAX);
+    // every decoder has a second table to prune into if it prunes
+    size_t max_size = (size_t) 1 << max_bits;
+    size_t decoder = (max_bits > 10 ? 2 : 1) * decompression_strtable_memory(max_size);
+    return streams * decoder + BLOCK_SIZE + slots;
+}
@@ -0,0 +1,69 @@
+/*
+Round-trip verification of compressed output while it is being produced.
+Finished blocks are handed to a decoder running on its own thread, which decodes them
+in order and compares the result against a copy of the input they came from.
+*/
+#ifndef VERIFY
+#define VERIFY
+#include <stddef.h>
+#include <pthread.h>
+#include "decompress.h"
+
+// Number of blocks that can wait for verification before the encoder has to wait.
+#define VERIFY_QUEUE_SLOTS 4
+
+struct verify_slot {
+    unsigned char *raw; // the input the block was made from
+    size_t raw_size;
+    unsigned char *record; // the block as written, header included
+    size_t record_size;
+};
+
+typedef struct verify_slot verify_slot;
+
+struct verifier {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    decompress_context *ctx;
+    unsigned char *decoded;
+
+    verify_slot slots[VERIFY_QUEUE_SLOTS];
+    int head; // next slot to verify
+    int count; // number of queued slots
+    int done; // no more blocks will be submitted
+
+    size_t verified_bytes; // input bytes verified so far
+    int failed; // set once a block didn't round-trip
+    size_t failed_offset; // input offset of the first block that failed
+};
+
+typedef struct verifier verifier;
+
+/*
+Constructs a verifier for a stream written with the given settings and STREAM_FLAG_* flags and starts its thread.
+The returned verifier is dynamically allocated and must be freed with verifier_free.
+*/
+verifier *verifier_new(int max_bits, int streams, int flags);
+
+/*
+Queues a block for verification: `record` is the block exactly as written to the output and
+`raw` the input it encodes. Both are copied, so the caller can reuse its buffers right away.
+Blocks until a queue slot is free. Returns 0, or -1 once any earlier block has failed verification.
+*/
+int verifier_submit(verifier *v, const unsigned char *raw, size_t raw_size, const unsigned char *record, size_t record_size);
+
+/*
+Waits for every queued block to be verified and stops the thread.
+Returns 0 if all blocks round-tripped, -1 otherwise.
+*/
+int verifier_finish(verifier *v);
+
+// Frees a verifier. verifier_finish must have been called first.
+void verifier_free(verifier *v);
+
+// Upper bound on the bytes a verifier with the given settings allocates.
+size_t verifier_memory(int max_bits, int streams);
+
+#endif